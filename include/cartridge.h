@@ -1,42 +1,88 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
+#include "cartridge_header.h"
+#include "machine_state.h"
+#include "paged_ram.h"
+#include "rom_image.h"
 
-enum class MBCType {
-    None,
-    MBC1,
-    MBC2,
-    MBC3,
-    MBC5,
-    Unknown
-};
+class SaveFile;
 
 class Cartridge {
 public:
-    void Load(const std::vector<uint8_t>& data);
+    Cartridge(MBCState& state);
+    ~Cartridge();
+    void Load(std::shared_ptr<const RomImage> image);
+    // Moves battery-backed RAM into the .sav file at `path`, loading any
+    // previous save. Does nothing for carts without a battery.
+    void OpenSaveFile(const std::string& path);
+    // Becomes a fork of `parent`: same ROM image and header, RAM pages
+    // shared copy-on-write, and no save file (a fork never writes the
+    // parent's .sav). MBC registers live in the machine state.
+    void ForkFrom(const Cartridge& parent);
 
-    const std::string& GetTitle() const { return title; }
+    const CartridgeHeader& GetHeader() const { return header; }
+    const std::string& GetTitle() const { return header.title; }
     MBCType GetMBCType() const { return mbcType; }
 
-    const std::vector<uint8_t>& GetROM() const { return rom; }
-    std::vector<uint8_t>& GetRAM() { return ram; }
+    // The ROM is shared and immutable; banking only ever indexes into it.
+    const uint8_t* GetROM() const { return rom; }
+    size_t GetROMSize() const { return romSize; }
+    const std::shared_ptr<const RomImage>& GetImage() const { return image; }
+    PagedRAM& GetRAM() { return ram; }
+    const PagedRAM& GetRAM() const { return ram; }
+    // Replaces the RAM contents, e.g. from a snapshot. Saved RAM is written
+    // through to the save file.
+    void RestoreRAM(const PagedRAM& from);
+    size_t GetRAMSize() const { return ramSizeBytes; }
 
-    bool HasRAM() const { return !ram.empty(); }
+    bool HasRAM() const { return ramSizeBytes > 0; }
     bool HasBattery() const { return hasBattery; }
+    // Saved RAM has to see every write to track dirty pages, so it is never
+    // mapped for direct writes.
+    bool HasSaveFile() const { return save != nullptr; }
+
+    // MBC register write (0x0000-0x7FFF). Returns true when the ROM or RAM
+    // mapping changed, i.e. the caller's page table needs refreshing.
+    bool WriteRegister(uint16_t addr, uint8_t data);
+    uint16_t GetROMBank0() const;   // bank mapped at 0x0000-0x3FFF
+    uint16_t GetROMBank() const;    // bank mapped at 0x4000-0x7FFF
+    // True when 0xA000-0xBFFF is plain RAM starting at GetRAMBankOffset().
+    // MBC2 nibbles, RTC registers and disabled RAM go through ReadRAM/WriteRAM.
+    bool IsRAMMapped() const;
+    size_t GetRAMBankOffset() const;
+    uint8_t ReadRAM(uint16_t addr);
+    // Returns true when the write copied a shared RAM page, i.e. the
+    // caller's page table needs refreshing.
+    bool WriteRAM(uint16_t addr, uint8_t data);
 
 private:
     void ParseHeader();
     void AllocateRAM();
 
+    // MBC3 clock registers (S, M, H, DL, DH) at `seconds` on the counter.
+    void SplitRTC(int64_t seconds, uint8_t regs[5]) const;
+    int64_t RTCSeconds() const;
+    void WriteRTC(uint8_t reg, uint8_t data);
+
 private:
-    std::vector<uint8_t> rom;
-    std::vector<uint8_t> ram;
+    std::shared_ptr<const RomImage> image;
+    const uint8_t* rom = nullptr;
+    size_t romSize = 0;
+    PagedRAM ram;                   // private pages, or the save file's mapping
+    SaveFile* save = nullptr;
 
-    std::string title;
+    CartridgeHeader header;
 
     MBCType mbcType = MBCType::Unknown;
     bool hasBattery = false;
+    bool hasRTC = false;
+
+    MBCState& state;
+    uint16_t romBankCount = 2;
 
     uint32_t romSizeBytes = 0;
     uint32_t ramSizeBytes = 0;
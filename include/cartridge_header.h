@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class MBCType {
+    None,
+    MBC1,
+    MBC2,
+    MBC3,
+    MBC5,
+    Unknown
+};
+
+// The cartridge header (0x0100-0x014F) decoded. Parsing only needs these
+// 80 bytes, so a library can be indexed without loading whole ROMs.
+struct CartridgeHeader {
+    static constexpr uint16_t START = 0x0100;
+    static constexpr uint16_t SIZE = 0x50;
+    using Bytes = std::array<uint8_t, SIZE>;
+
+    std::string title;
+    uint8_t type = 0;           // raw cartridge type (0x0147)
+    MBCType mbcType = MBCType::Unknown;
+    bool hasBattery = false;
+    bool hasRTC = false;
+    uint32_t romSizeBytes = 0;  // as declared; 0 for an unknown size code
+    uint32_t ramSizeBytes = 0;
+    uint8_t headerChecksum = 0; // 0x014D
+    uint16_t globalChecksum = 0;// 0x014E-0x014F, big-endian
+
+    // True when the stored header checksum matches 0x0134-0x014C. The boot
+    // ROM refuses to start a cartridge that fails it.
+    bool headerValid = false;
+
+    static CartridgeHeader Parse(const Bytes& bytes);
+    // Sum of every ROM byte except the two checksum bytes, as stored at
+    // 0x014E. Nothing checks it on hardware; it identifies bad dumps.
+    // `data` holds the ROM from `offset` on, so a file can be summed chunk
+    // by chunk and the partial sums added.
+    static uint16_t GlobalSum(const uint8_t* data, size_t size, size_t offset = 0);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "sm83.h"
+
+class Gameboy;
+
+// Predecoded instructions for every address that can hold code (ROM, WRAM,
+// HRAM). Storage is allocated on first use: per ROM bank, and for RAM
+// once the CPU first executes from WRAM or HRAM. ROM entries are kept per bank, so a bank switch selects another set
+// of entries instead of throwing the old ones away. RAM entries are dropped
+// when Gameboy::WriteMem touches the instruction or its operands.
+class DecodeCache{
+public:
+    struct Entry {
+        const SM83::Opcode* op = nullptr;   // nullptr until decoded
+        uint8_t opcodeLength = 0;           // 1, or 2 for 0xCB-prefixed opcodes
+        uint8_t operands[2] = {};
+    };
+
+    DecodeCache(Gameboy& gb);
+
+    // Returns the decoded instruction at addr, or nullptr for regions that
+    // are never cached (VRAM, cartridge RAM, OAM, IO) and for everything
+    // below FF00 while OAM DMA holds the bus.
+    const Entry* Lookup(uint16_t addr);
+    void Invalidate(uint16_t addr);
+    // Forgets every entry, e.g. when the boot ROM overlay is unmapped or the
+    // whole machine state was replaced. Storage is kept for reuse.
+    void Flush();
+
+    uint64_t GetHits() const { return hits; }
+    uint64_t GetMisses() const { return misses; }
+    // Heap bytes held by the entries allocated so far.
+    size_t GetAllocatedBytes() const;
+
+private:
+    Gameboy& gb;
+
+    std::vector<std::vector<Entry>> romBanks;   // 0000-7FFF, indexed by bank
+    static constexpr size_t RAM_ENTRIES = 0x2000 + 0x7F;
+    std::vector<Entry> ram;                     // C000-DFFF then FF80-FFFE, empty until used
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    Entry* Slot(uint16_t addr);
+};
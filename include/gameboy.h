@@ -1,27 +1,171 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include "machine_state.h"
+#include "paged_ram.h"
+
+const uint32_t CYCLES_PER_FRAME = 70224;
 
 class PPU;
 class SM83;
 class Cartridge;
+class Timer;
 
 class Gameboy{
 public:
+    // A copy of the machine. RAM pages are shared with the machine (and
+    // with other snapshots) until either side writes to them.
+    struct Snapshot {
+        MachineState state;
+        PagedRAM wram;
+        PagedRAM cartRAM;
+    };
+
     Gameboy();
+    // Runs on caller-provided storage, e.g. one slot of a preallocated slab
+    // holding many machines. The arena must outlive the Gameboy.
+    explicit Gameboy(MachineState* arena);
+    ~Gameboy();
     void LoadCartridgeFromFile(const char* filepath);
+    // Forks the machine for search: the child gets a copy of the machine
+    // state and shares WRAM and cartridge RAM page by page, copying a page
+    // only on its first write. The ROM image is shared; the save file is not.
+    Gameboy* Clone();
+    // The machine starts in the state the DMG boot ROM leaves behind. This
+    // runs a real boot ROM (256 bytes) instead: it is overlaid on
+    // 0000-00FF until the game writes to FF50.
+    void LoadBootROM(const char* filepath);
+    // Bytes of emulator state this instance owns: the component objects,
+    // private WRAM and cartridge RAM pages, the decode cache and recompiled
+    // code allocated so far, and the 32-bit frame once something has asked
+    // for it. The ROM image is shared and not counted.
+    size_t GetInstanceMemory() const;
     void Boot();
-    uint8_t ReadMem(uint16_t addr);
-    void WriteMem(uint16_t addr, uint8_t data);
+    // Advance the machine by at least `cycles` T-cycles. The CPU runs
+    // uninterrupted up to the next scheduled event, which is dispatched
+    // before continuing. Returns the cycles actually run (instruction
+    // granularity can overshoot a deadline by one instruction; recompiled
+    // blocks that don't fit before it are interpreted instead).
+    uint32_t RunCycles(uint32_t cycles);
+    // Runs until the PPU enters VBlank and returns the cycles it took.
+    uint32_t RunFrame();
+    // Cycles the last RunFrame jumped over while the CPU sat in HALT/STOP.
+    uint32_t GetSkippedCycles() const { return frameSkippedCycles; }
+    // Iterations of LY/STAT polling loops the last RunFrame skipped.
+    uint32_t GetSkippedIdleLoops() const { return frameSkippedIdleLoops; }
+    // Tile rows the last RunFrame re-decoded because tile data changed.
+    uint32_t GetTileUpdates() const { return frameTileUpdates; }
+    // Draws only every `interval`-th frame (1: every frame, 0: none). The
+    // game can't tell: PPU modes, LY, STAT and interrupts keep their exact
+    // timing, only the pixels are left out.
+    void SetRenderInterval(uint32_t interval);
+    uint32_t GetRenderInterval() const;
+    // How the CPU runs between events. The default is the path the build
+    // selects (GB_RECOMPILER, GB_THREADED_INTERPRETER, else the opcode
+    // table); the others stay available for comparison.
+    enum class CPUPath { Table, Threaded, Recompiled };
+    void SetCPUPath(CPUPath path) { cpuPath = path; }
+    CPUPath GetCPUPath() const { return cpuPath; }
+    void Benchmark();
+    // Pages backed by plain storage are a single lookup; everything else
+    // goes through ReadSlow/WriteSlow.
+    uint8_t ReadMem(uint16_t addr)
+    {
+        const uint8_t* page = readPages[addr >> 8];
+        return page != nullptr ? page[addr & 0xFF] : ReadSlow(addr);
+    }
+    void WriteMem(uint16_t addr, uint8_t data)
+    {
+        uint8_t* page = writePages[addr >> 8];
+        if (page != nullptr) { page[addr & 0xFF] = data; } else { WriteSlow(addr, data); }
+    }
+    // ROM banks currently mapped at 0x0000-0x3FFF and 0x4000-0x7FFF.
+    uint16_t GetROMBank0() const;
+    uint16_t GetROMBank() const;
+    Scheduler& GetScheduler() { return scheduler; }
+    MachineState& GetState() { return *state; }
+    // Snapshots copy the arena and share the RAM pages. Loading one
+    // re-points the page table at the restored banks and drops all decoded
+    // code.
+    void SaveState(Snapshot& out);
+    void LoadState(const Snapshot& in);
+    // Sets bit `interrupt` of IF (0 VBlank, 1 STAT, 2 Timer, 3 Serial, 4 Joypad).
+    void RequestInterrupt(uint8_t interrupt) { state->io[0x0F] |= (1 << interrupt); }
+    void AcknowledgeInterrupt(uint8_t interrupt) { state->io[0x0F] &= ~(1 << interrupt); }
+    // Interrupts both requested in IF and enabled in IE.
+    uint8_t PendingInterrupts() const { return state->ie & state->io[0x0F] & 0x1F; }
+    // While OAM DMA runs the CPU reads 0xFF below FF00, so code fetched
+    // there must not be cached.
+    bool IsDMAActive() const { return state->dma.active; }
+    // Runs small hand-assembled programs on every CPU path and checks when
+    // interrupts are taken and when the OAM DMA lockout begins.
+    static bool VerifyInterrupts();
+    // Forks configured machines and checks the children run the same way.
+    static bool VerifyClone();
     
 private:
+    uint32_t RunCPU(uint32_t cycles);
+    void DispatchEvents();
+
+    uint8_t ReadSlow(uint16_t addr);
+    void WriteSlow(uint16_t addr, uint8_t data);
+    // Writes WRAM (offset from C000), copying the page if a fork still
+    // shares it.
+    void WriteWRAM(uint16_t offset, uint8_t data);
+    // Points every page at its backing storage. Only MapCartridge needs to
+    // run again, after an MBC register write.
+    void MapPages();
+    // Cartridge pages only. It knows nothing of the DMA lockout, so outside
+    // MapPages it may only run when the CPU can reach the cartridge.
+    void MapCartridge();
+    // Installs the IO register handlers. Only called from the constructor.
+    void MapIO();
+    // Registers and IO exactly as the boot ROM hands over at 0100.
+    void FastBoot();
+    // OAM DMA (write to FF46). The default build copies all 160 bytes at
+    // once and only holds the bus for the transfer time; GB_ACCURATE_DMA
+    // moves one byte per M-cycle for test ROMs that race the transfer.
+    void StartDMA(uint8_t source);
+    void OnDMAEvent();
+
+    // One entry per 256-byte page, nullptr where the access needs a handler:
+    // IO/HRAM, OAM and the unusable area, MBC registers, cartridge space the
+    // image doesn't cover, and writes with side effects (WRAM drops decoded
+    // code, tile data updates the tile cache).
+    std::array<const uint8_t*, 256> readPages{};
+    std::array<uint8_t*, 256> writePages{};
+
+    // Handlers for the IO registers (FF00-FF7F) with side effects, indexed
+    // by the low seven address bits. A null entry is plain storage in
+    // state->io, so registers without side effects cost one array access.
+    using IORead = uint8_t (*)(Gameboy& gb, uint8_t reg);
+    using IOWrite = void (*)(Gameboy& gb, uint8_t reg, uint8_t data);
+    std::array<IORead, 0x80> ioReads{};
+    std::array<IOWrite, 0x80> ioWrites{};
+    const uint8_t* dmaSource = nullptr;   // source page of the running DMA, nullptr reads 0xFF
+    std::array<uint8_t, 0x100> bootROM{};
+
+    // All emulated state but the paged RAM; everything below it is host-side.
+    MachineState* state;
+    PagedRAM wram{0x2000};               // Work RAM (C000-DFFF)
+    bool ownsState;
+    Scheduler& scheduler;
     PPU* ppu;
     SM83* cpu;
     Cartridge* cartridge;
-    std::array<uint8_t, 0x2000> wram{};   // Work RAM (C000-DFFF)
-    std::array<uint8_t, 0x2000> vram{};   // Video RAM (8000-9FFF)
-    std::array<uint8_t, 0xA0> oam{};      // Sprite attribute table (FE00-FE9F)
-    std::array<uint8_t, 0x80> hram{};     // High RAM (FF80-FFFE)
-    std::array<uint8_t, 0x80> io{};       // IO registers (FF00-FF7F)
-    uint8_t ie{};                         // Interrupt Enable Register (FFFF)
+    Timer* timer;
+#if defined(GB_RECOMPILER)
+    CPUPath cpuPath = CPUPath::Recompiled;
+#elif defined(GB_THREADED_INTERPRETER)
+    CPUPath cpuPath = CPUPath::Threaded;
+#else
+    CPUPath cpuPath = CPUPath::Table;
+#endif
+    uint64_t skippedCycles = 0;          // total cycles fast-forwarded in HALT/STOP
+    uint32_t frameSkippedCycles = 0;
+    uint64_t skippedIdleLoops = 0;       // total polling-loop iterations skipped
+    uint32_t frameSkippedIdleLoops = 0;
+    uint32_t frameTileUpdates = 0;
 };
\ No newline at end of file
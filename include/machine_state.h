@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include "register.h"
+#include "scheduler.h"
+
+enum PPUMode : uint8_t { HBLANK=0, VBLANK=1, OAM=2, DRAW=3 };
+
+// Everything the emulated machine is, as plain data, except for WRAM and
+// cartridge RAM: those are paged so forks can share them (PagedRAM). The
+// components (SM83, PPU, Timer, Cartridge) hold a reference to their part
+// and keep only host-side resources (window, code caches, ROM image, save
+// file) to themselves.
+
+struct CPUState {
+    // BC, DE and HL overlay their 8-bit halves so pair reads and writes are
+    // a single 16-bit access. AF stays split: F carries lazy flag state.
+    union { uint16_t bc; struct { ByteRegister c, b; }; };
+    union { uint16_t de; struct { ByteRegister e, d; }; };
+    union { uint16_t hl; struct { ByteRegister l, h; }; };
+    ByteRegister a;
+    FlagRegister f;
+    WordRegister pc, sp;
+
+    bool halted;            // HALT, and nothing else
+    bool stopped;           // STOP: only a joypad interrupt wakes the CPU
+    bool yield;             // the run loop returns after this instruction (see SM83::IsYielding)
+    bool locked;
+    bool branched;
+    bool interrupts_enabled;
+    uint8_t idlePeriod;     // cycles per iteration of the parked idle loop
+    uint64_t instructions;
+};
+
+struct PPUState {
+    uint64_t modeEnd;       // absolute cycle at which the current mode ends
+    uint64_t frames;
+    ByteRegister control;
+    ByteRegister status;
+    uint8_t ly;
+    uint8_t lx;
+    uint8_t windowLine;     // window row drawn next; only advances on lines that show it
+    PPUMode mode;
+};
+
+struct TimerState {
+    uint64_t counterBase;   // cycle at which the 16-bit divider was last 0
+    uint64_t lastSync;      // cycle TIMA was last brought up to date
+    uint8_t tima;
+    uint8_t tma;
+    uint8_t tac;
+};
+
+// Bank registers as last written. Banks are resolved on demand, so a
+// switch never copies ROM or RAM.
+struct MBCState {
+    bool ramEnabled;
+    uint16_t romBank;       // MBC1 low 5 bits, MBC2 4, MBC3 7, MBC5 9
+    uint8_t ramBank;        // MBC1 upper bits, MBC3 RAM bank or RTC register
+    bool bankingMode;       // MBC1 mode select
+
+    // The RTC is never ticked: its value is derived from host time when the
+    // game latches or writes it.
+    int64_t rtcBase;        // host time (s) at which the counter read 0
+    int64_t rtcHaltedAt;    // counter value while the halt bit is set
+    bool rtcHalted;
+    bool rtcCarry;
+    uint8_t rtcLatched[5];
+    uint8_t rtcLatchPrev;
+};
+
+// OAM DMA in flight. The bus is blocked from `start` to start + 640.
+struct DMAState {
+    uint64_t start;
+    bool active;
+    uint8_t source;         // high byte of the source address
+    uint8_t next;           // bytes copied so far
+};
+
+// Hot state first: the CPU registers and the clock every instruction
+// advances share the leading cache lines; memory follows line-aligned.
+struct alignas(64) MachineState {
+    CPUState cpu;
+    Scheduler scheduler;
+    PPUState ppu;
+    TimerState timer;
+    MBCState mbc;
+    DMAState dma;
+
+    alignas(64) std::array<uint8_t, 0x2000> vram;   // Video RAM (8000-9FFF)
+    alignas(64) std::array<uint8_t, 0xA0> oam;      // Sprite attribute table (FE00-FE9F)
+    alignas(64) std::array<uint8_t, 0x80> hram;     // High RAM (FF80-FFFE)
+    std::array<uint8_t, 0x80> io;                   // IO registers (FF00-FF7F)
+    uint8_t ie;                                     // Interrupt Enable Register (FFFF)
+    bool bootROMMapped;                             // boot ROM overlays 0000-00FF until FF50 is written
+};
+
+static_assert(std::is_trivially_copyable_v<MachineState>, "snapshots copy MachineState with memcpy");
+static_assert(std::is_standard_layout_v<MachineState>);
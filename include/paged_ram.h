@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// RAM in 256-byte pages (one page table entry each) that forked machines
+// share until one side writes: Fork only copies page references, and a
+// shared page is copied on its first write. A fresh RAM shares one zero
+// page, so it costs nothing until it is written either.
+class PagedRAM{
+public:
+    static constexpr size_t PAGE_SIZE = 0x100;
+
+    PagedRAM() = default;
+    explicit PagedRAM(size_t size);
+    // Pages alias `memory` (e.g. a save file mapping) and are written in
+    // place. `memory` must outlive this object. Forks share a heap snapshot
+    // of each page instead, taken by the first fork after the page was last
+    // written and dropped by the next write, so only pages written since the
+    // previous fork are copied.
+    PagedRAM(uint8_t* memory, size_t size);
+
+    // A RAM with the same contents that shares every page with this one.
+    PagedRAM Fork() const;
+
+    size_t Size() const { return size; }
+    size_t PageCount() const { return pages.size(); }
+    const uint8_t* ReadPage(size_t page) const { return pages[page]->data(); }
+    // The page for writing, copied first if anything else still shares it.
+    uint8_t* WritePage(size_t page);
+    // The page for writing if it is already private, otherwise nullptr.
+    uint8_t* OwnedPage(size_t page) { return IsShared(page) ? nullptr : pages[page]->data(); }
+    bool IsShared(size_t page) const
+    {
+        return external ? snapshots[page] != nullptr : pages[page].use_count() > 1;
+    }
+
+    uint8_t Read(size_t offset) const { return (*pages[offset / PAGE_SIZE])[offset % PAGE_SIZE]; }
+    void Write(size_t offset, uint8_t value) { WritePage(offset / PAGE_SIZE)[offset % PAGE_SIZE] = value; }
+    // Takes over the contents of `other`: pages are shared where both sides
+    // allow it, and copied into external memory in place.
+    void Assign(const PagedRAM& other);
+
+    // Bytes held only by this RAM, i.e. what a fork of it has cost so far.
+    // External RAM counts its pages and the snapshots its forks share.
+    size_t GetPrivateBytes() const;
+
+private:
+    using Page = std::array<uint8_t, PAGE_SIZE>;
+
+    std::vector<std::shared_ptr<Page>> pages;
+    // External RAM only: per page, the copy forks were given, or nullptr
+    // once the page has been written since.
+    mutable std::vector<std::shared_ptr<Page>> snapshots;
+    size_t size = 0;
+    bool external = false;
+};
@@ -1,18 +1,69 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 #include "gameboy.h"
-#include "register.h"
+#include "machine_state.h"
+#include "scanline.h"
+#include "tile_cache.h"
 #include "window.h"
-enum PPUMode { HBLANK=0, VBLANK=1, OAM=2, DRAW=3 };
 
 const int CLOCK_RATE = 4194304;
 
+// One flag per pixel of a line, bit x for pixel x (bits 160-191 unused).
+struct LineMask {
+    uint64_t w[3];
+};
+
 class PPU{
 public:
     PPU(Gameboy& gb);
-    void Tick(int cycles);
-    const uint32_t* GetFrameBuffer() const;
+    // Finishes the current mode and posts the end of the next one.
+    void OnModeEvent();
+    // Cycles until the PPU next enters mode 1 (line 144, dot 0).
+    uint32_t CyclesUntilVBlank() const;
+    uint64_t GetFrameCount() const { return state.frames; }
+    uint8_t GetLY() const { return state.ly; }
+    uint8_t GetControl() const { return state.control.Get(); }
+    // LCDC. Turning the display off resets LY and stops the PPU until it is
+    // turned back on.
+    void WriteControl(uint8_t value);
+    // STAT as the CPU sees it: the written interrupt selects plus the live
+    // LY=LYC flag and mode bits.
+    uint8_t ReadSTAT(uint8_t lyc) const;
+    void WriteSTAT(uint8_t value) { state.status.Set(value & 0x78); }
+    // CPU write to tile data (offset from 8000, below 1800). The tile cache
+    // is only touched when the byte actually changes.
+    void WriteTileData(uint16_t offset, uint8_t data);
+    // OAM changed (CPU write or DMA); the sprite lists are rebuilt at the
+    // next OAM scan.
+    void InvalidateSprites() { spritesDirty = true; }
+    // Re-derives the tile cache and sprite lists after VRAM and OAM were
+    // replaced wholesale.
+    void RebuildCaches() { tiles.Rebuild(vram.data()); spritesDirty = true; }
+    const TileCache& GetTileCache() const { return tiles; }
+    // The frame as 32-bit pixels in the display colours. The PPU only keeps
+    // shades, so this converts on every call; frames nobody asks for never
+    // pay for it (or for the 32-bit buffer).
+    const uint32_t* GetFrameBuffer();
+    // The frame as drawn: one shade (0-3, lightest first) per pixel.
+    const uint8_t* GetShadeBuffer() const { return frameBuffer; }
+    // Colours GetFrameBuffer maps shades 0-3 to, e.g. a tinted palette.
+    void SetDisplayColors(const std::array<uint32_t, 4>& colors) { displayColors = colors; }
+    size_t GetDisplayBufferBytes() const { return displayBuffer.capacity() * sizeof(uint32_t); }
+    // Draw every `interval`-th frame only (1: all, 0: none). Skipped frames
+    // run the same mode events; the frame buffer keeps the last drawn frame.
+    void SetRenderInterval(uint32_t interval) { renderInterval = interval; }
+    uint32_t GetRenderInterval() const { return renderInterval; }
+    // Kernel the background and window are drawn with. Defaults to the
+    // fastest one the host supports.
+    void SetScanlineKernel(const ScanlineKernel& k) { kernel = k; }
+    const ScanlineKernel& GetScanlineKernel() const { return kernel; }
+    // Average host time in ns to draw one line from the current VRAM and
+    // registers, over `lines` lines. Used by --bench.
+    double TimeScanlines(int lines);
+    // Average host time in ns of one GetFrameBuffer conversion.
+    double TimeFrameConversion(int frames);
 private:
 
     unsigned int GAMEBOY_WIDTH = 160;
@@ -21,29 +72,58 @@ private:
 
     Gameboy& gb;
     Window window;
-
-    ByteRegister control;
-    
-    bool DisplayEnabled(){ return check_bit(control.Get(), 7); };
-    bool WindowTileMap(){ return check_bit(control.Get(), 6); };
-    bool WindowEnabled(){ return check_bit(control.Get(), 5); };
-    bool BackgroundWindowTile(){ return check_bit(control.Get(), 4); };
-    bool BackgroundTileMap(){ return check_bit(control.Get(), 3); };
-    bool SpriteSize(){ return check_bit(control.Get(), 2); };
-    bool SpritesEnabled(){ return check_bit(control.Get(), 1); };
-    bool BackgroundEnabled(){ return check_bit(control.Get(), 0); };
-
-    ByteRegister status;
+    PPUState& state;
+    std::array<uint8_t, 0x2000>& vram;
+    TileCache tiles;
+    const std::array<uint8_t, 0x80>& io;
+    const std::array<uint8_t, 0xA0>& oam;
+    ScanlineKernel kernel = ScanlineKernel::Best();
     
+    bool DisplayEnabled(){ return check_bit(state.control.Get(), 7); };
+    bool WindowTileMap(){ return check_bit(state.control.Get(), 6); };
+    bool WindowEnabled(){ return check_bit(state.control.Get(), 5); };
+    bool BackgroundWindowTile(){ return check_bit(state.control.Get(), 4); };
+    bool BackgroundTileMap(){ return check_bit(state.control.Get(), 3); };
+    bool SpriteSize(){ return check_bit(state.control.Get(), 2); };
+    bool SpritesEnabled(){ return check_bit(state.control.Get(), 1); };
+    bool BackgroundEnabled(){ return check_bit(state.control.Get(), 0); };
+    // WY reached and WX on screen
+    bool WindowOnLine() const { return state.ly >= io[0x4A] && io[0x4B] <= 166; }
+    bool RendersFrame() const { return renderInterval != 0 && state.frames % renderInterval == 0; }
+
     void DrawScanline();
-    void DrawBackgroundLine();
-    void DrawWindowLine();
+    // Both also mark the pixels they leave non-zero in `opaque`, which is
+    // what BG-priority sprites hide behind.
+    void DrawBackgroundLine(const uint8_t* shades, LineMask& opaque);
+    void DrawWindowLine(const uint8_t* shades, LineMask& opaque);
+    void DrawSpriteLine(const LineMask& background);
+    // Cached rows `y` of `count` consecutive tiles of one tile map row
+    // (`map` is its offset in VRAM), wrapping at the map's 32 columns, and
+    // their opaque masks.
+    void FetchRows(const uint8_t** rows, uint8_t* masks, int count, uint16_t map, uint8_t column, uint8_t y);
+
+    // Sprite selection for every line at once. OAM rarely changes within a
+    // frame, so the lists are only rebuilt at an OAM scan after OAM or the
+    // sprite height changed.
+    void ScanOAM();
+    void BuildSpriteLists();
     void DrawSpriteLine();
 
-    unsigned int cycles;
-    uint8_t ly;
-    uint8_t lx;
+    void ScheduleModeEnd(uint32_t duration);
+
+    // Default display colours (0xAARRGGBB) for shades 0-3
+    static constexpr uint32_t SHADES[4] = { 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000 };
+
+    static constexpr int MAX_LINE_SPRITES = 10;
+    // OAM indices of each line's sprites: the first 10 in OAM order, then
+    // sorted into drawing priority (lower X first, ties in OAM order).
+    std::array<std::array<uint8_t, MAX_LINE_SPRITES>, 144> lineSprites{};
+    std::array<uint8_t, 144> lineSpriteCount{};
+    uint8_t spriteListHeight = 0;
+    bool spritesDirty = true;
+    uint32_t renderInterval = 1;
 
-    uint32_t frameBuffer[160 * 144];
-    PPUMode mode = PPUMode::OAM;
+    uint8_t frameBuffer[160 * 144]{};
+    std::vector<uint32_t> displayBuffer;    // allocated by the first GetFrameBuffer
+    std::array<uint32_t, 4> displayColors = { SHADES[0], SHADES[1], SHADES[2], SHADES[3] };
 };
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include <array>
+#include <utility>
+
+class SM83;
+class Gameboy;
+
+// Basic-block recompiler translating SM83 code into x86-64.
+// Register moves and loads, JP/JR, and (with GB_LAZY_FLAGS) the 8-bit ALU
+// ops, INC/DEC on registers and conditional jumps on the flags those just
+// set are emitted natively. Every other instruction is a
+// call back into the interpreter's handler for that opcode. The clock is
+// advanced before each such call, so handlers see the time their
+// instruction starts at, exactly as in the interpreter.
+class Recompiler{
+public:
+    Recompiler(SM83& cpu, Gameboy& gb);
+    ~Recompiler();
+
+    // Runs the block starting at the current PC, compiling it first if needed.
+    // A block longer than `budget` cycles is not started: the interpreter
+    // runs the rest of the budget instead, so a deadline is overshot by one
+    // instruction at most. Returns the cycles consumed.
+    uint32_t Execute(uint32_t budget);
+    void Invalidate(uint16_t addr);
+    void Flush();
+
+    bool IsAvailable() const { return buffer != nullptr; }
+    size_t GetBlockCount() const { return blocks.size(); }
+    // Heap bytes in use: emitted code plus the block index. The rest of the
+    // code buffer is reserved but never touched.
+    size_t GetAllocatedBytes() const;
+
+private:
+    // Returns the instructions run in the high half and their cycles in the
+    // low half: a block leaves early once a handler makes the CPU yield
+    // (an interrupt made due).
+    using BlockFn = uint32_t (*)(SM83*);
+    using HandlerFn = void (*)(SM83*, uint32_t);
+
+    struct Block {
+        BlockFn code;
+        uint32_t cycles;
+        uint32_t instructions;
+        uint16_t start;
+        uint16_t end;
+    };
+
+    static const size_t BUFFER_SIZE = 4 * 1024 * 1024;
+    static const int MAX_BLOCK_INSTRUCTIONS = 64;
+    static const uint8_t RETURN_BYTES = 13;     // length of EmitReturn's code
+
+    SM83& cpu;
+    Gameboy& gb;
+
+    uint8_t* buffer = nullptr;
+    size_t used = 0;
+
+    std::unordered_map<uint32_t, Block> blocks;
+    // Keys of the blocks compiled from each 256-byte RAM page, so writes
+    // to pages that hold no code cost a single lookup.
+    std::array<std::vector<uint32_t>, 256> codePages;
+
+    uint32_t MakeKey(uint16_t addr);
+    bool Compile(uint16_t addr, Block& block);
+
+    // Sets PC past the opcode and calls its interpreter handler directly.
+    template <bool CB, uint8_t N>
+    static void CallHandler(SM83* cpu, uint32_t next);
+    template <bool CB, size_t... N>
+    static constexpr std::array<HandlerFn, 256> MakeHandlerTable(std::index_sequence<N...>);
+    // Materializes deferred flags before a native INC/DEC, which keeps C.
+    static void ResolveFlags(SM83* cpu);
+
+    // call fn(cpu): mov rdi/rcx, r13; mov rax, fn; call rax
+    void EmitCall(const void* fn);
+    // add qword [now], cycles (nothing for 0)
+    void EmitAdvance(uint32_t cycles);
+    // mov eax, result, then the epilogue and ret
+    void EmitReturn(uint32_t result);
+
+    void Emit8(uint8_t byte);
+    void Emit16(uint16_t word);
+    void Emit32(uint32_t dword);
+    void Emit64(uint64_t qword);
+    int32_t Offset(const void* field);
+};
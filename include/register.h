@@ -1,5 +1,7 @@
 #pragma once
 #include <cstdint>
+#include <bit>
+#include <type_traits>
 
 inline auto check_bit(const uint8_t value, const uint8_t bit) -> bool { return (value & (1 << bit)) != 0; }
 
@@ -13,42 +15,83 @@ inline auto clear_bit(const uint8_t value, const uint8_t bit) -> uint8_t {
     return static_cast<uint8_t>(value_cleared);
 }
 
+// Registers are plain bytes and words with inline accessors: no virtual
+// dispatch, trivially copyable, and small enough to stay in host registers.
 class ByteRegister{
 public:
-    ByteRegister() = default;
-    ByteRegister(uint8_t v) { val = v; }; 
-    virtual void Set(const uint8_t value);
-    uint8_t Get() const { return val; };
-    void Increment();
-    void Decrement();
+    void Set(const uint8_t value) { val = value; }
+    uint8_t Get() const { return val; }
+    uint8_t* Data() { return &val; }
+    void Increment() { val += 1; }
+    void Decrement() { val -= 1; }
 protected:
-    uint8_t val = 0x0;
+    uint8_t val;
 };
 
-class FlagRegister : public ByteRegister{
+// ALU operations whose flags FlagRegister can compute on demand.
+// Add/Sub take the carry-in as a third operand; Inc/Dec/And/Logic only need the result.
+// And differs from the other logic ops only in setting H.
+// AddSP is SP+e8 (ADD SP / LD HL,SP+): H and C of the low-byte add, Z always clear.
+enum class FlagOp : uint8_t { None, Add, Sub, Inc, Dec, And, Logic, AddSP };
+
+// F is not a ByteRegister: the low nibble is masked on writes and the
+// flags may still be pending from the last ALU operation.
+class FlagRegister{
 public:
-    FlagRegister(uint8_t v) { val = v; }; 
-    void Set(const uint8_t value) override;
-
-    void SetZero(bool set);
-    void SetSubtract(bool set);
-    void SetHalfCarry(bool set);
-    void SetCarry(bool set);
-
-    bool Zero();
-    bool Subtract();
-    bool HalfCarry();
-    bool Carry();
+    FlagRegister() = default;
+    FlagRegister(uint8_t v) : val(v & 0xF0), pending(FlagOp::None), pendingLhs(0), pendingRhs(0), pendingCarry(0) {}
+    void Set(const uint8_t value) { pending = FlagOp::None; val = value & 0xF0; }
+    uint8_t Get() { Resolve(); return val; }
+
+    // Records the last ALU operation instead of computing Z/N/H/C. The flags
+    // are materialized the first time anything reads or modifies them.
+    void Defer(FlagOp op, uint8_t lhs, uint8_t rhs = 0, uint8_t carry = 0)
+    {
+        if (op == FlagOp::Inc || op == FlagOp::Dec) { Resolve(); } // keep C
+        pending = op;
+        pendingLhs = lhs;
+        pendingRhs = rhs;
+        pendingCarry = carry;
+    }
+
+    void SetZero(bool set) { Resolve(); val = set ? set_bit(val, 7) : clear_bit(val, 7); }
+    void SetSubtract(bool set) { Resolve(); val = set ? set_bit(val, 6) : clear_bit(val, 6); }
+    void SetHalfCarry(bool set) { Resolve(); val = set ? set_bit(val, 5) : clear_bit(val, 5); }
+    void SetCarry(bool set) { Resolve(); val = set ? set_bit(val, 4) : clear_bit(val, 4); }
+
+    bool Zero() { Resolve(); return check_bit(val, 7); }
+    bool Subtract() { Resolve(); return check_bit(val, 6); }
+    bool HalfCarry() { Resolve(); return check_bit(val, 5); }
+    bool Carry() { Resolve(); return check_bit(val, 4); }
+private:
+    friend class Recompiler;    // emits Defer inline
+
+    void Resolve() { if (pending != FlagOp::None) { Materialize(); } }
+    void Materialize();
+
+    uint8_t val;
+    FlagOp pending;
+    uint8_t pendingLhs;
+    uint8_t pendingRhs;
+    uint8_t pendingCarry;
 };
 
 class WordRegister{
 public:
-    WordRegister(uint16_t v) { val = v; }; 
-    void Set(const uint16_t value);
-    uint16_t Get() const { return val; };
-    void Increment();
-    void Decrement();
+    WordRegister() = default;
+    WordRegister(uint16_t v) : val(v) {}
+    void Set(const uint16_t value) { val = value; }
+    uint16_t Get() const { return val; }
+    uint16_t* Data() { return &val; }
+    void Increment() { val += 1; }
+    void Decrement() { val -= 1; }
 protected:
-    uint16_t val = 0x0;
+    uint16_t val;
 };
 
+// The 8-bit views of BC/DE/HL alias their 16-bit pair, low byte first.
+static_assert(std::endian::native == std::endian::little, "register pairs assume a little-endian host");
+
+static_assert(std::is_trivially_copyable_v<ByteRegister> && std::is_standard_layout_v<ByteRegister>);
+static_assert(std::is_trivially_copyable_v<FlagRegister> && std::is_standard_layout_v<FlagRegister>);
+static_assert(std::is_trivially_copyable_v<WordRegister> && std::is_standard_layout_v<WordRegister>);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read-only cartridge image. Mapped straight from the file where the
+// platform has mmap, otherwise read into a single buffer. Images are shared
+// by canonical path, so every Gameboy running the same ROM file in this
+// process points at one physical copy, however the path was spelled.
+class RomImage{
+public:
+    // Returns the live image for `path` if there is one, otherwise loads it.
+    // Throws std::runtime_error when the file can't be opened or is empty.
+    static std::shared_ptr<const RomImage> Open(const std::string& path);
+    // An image over bytes built in memory (test programs). Not shared.
+    static std::shared_ptr<const RomImage> FromBytes(std::vector<uint8_t> bytes);
+    ~RomImage();
+
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    const uint8_t* Data() const { return data; }
+    size_t Size() const { return size; }
+    bool IsMapped() const { return mapped; }
+    // Host time Open spent loading this image, in seconds.
+    double GetLoadTime() const { return loadTime; }
+
+private:
+    RomImage() = default;
+    bool Map(const std::string& path);
+    void Read(const std::string& path);
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    double loadTime = 0.0;
+    std::vector<uint8_t> buffer;    // backing store when not mapped
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cartridge_header.h"
+
+// Header index of a directory of ROMs. Files are parsed in parallel, and
+// the result is kept in a binary index file: on the next scan every file
+// whose path, mtime and size still match is taken from the index without
+// being opened.
+class RomLibrary{
+public:
+    struct Entry {
+        std::string path;
+        int64_t mtime = 0;              // last write time, filesystem clock ticks
+        uint64_t size = 0;
+        CartridgeHeader::Bytes headerBytes{};
+        CartridgeHeader header;
+        bool globalChecked = false;     // the whole file was summed
+        bool globalValid = false;       // ... and matched 0x014E-0x014F
+    };
+
+    // Indexes every .gb/.gbc file under `directory`, reusing `indexPath`
+    // and rewriting it when anything changed. Only the header region is
+    // read unless `verifyGlobal` asks for the (whole-file) global checksum.
+    // `threads` 0 means one worker per hardware thread.
+    void Scan(const std::string& directory, const std::string& indexPath, bool verifyGlobal = false, unsigned threads = 0);
+
+    // Sorted by path.
+    const std::vector<Entry>& GetEntries() const { return entries; }
+    size_t GetParsedCount() const { return parsed; }
+    size_t GetReusedCount() const { return reused; }
+
+private:
+    static constexpr uint32_t INDEX_MAGIC = 0x58494247;   // "GBIX"
+    static constexpr uint32_t INDEX_VERSION = 1;
+
+    // Fills in the header (and global checksum) of entry.path. False if the
+    // file can't be read or is too small to have a header.
+    static bool ReadEntry(Entry& entry, bool verifyGlobal);
+    static std::vector<Entry> LoadIndex(const std::string& indexPath);
+    void SaveIndex(const std::string& indexPath) const;
+
+    std::vector<Entry> entries;
+    size_t parsed = 0;
+    size_t reused = 0;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Battery-backed cartridge RAM kept in a .sav file. Where mmap is available
+// the RAM *is* the file mapping: the emulation thread only sets a dirty bit
+// per chunk, and a background writer msyncs the dirty chunks at most once
+// per FLUSH_INTERVAL, so a burst of SRAM writes never waits on the disk.
+// Elsewhere the RAM is a plain buffer written back in full on close.
+class SaveFile{
+public:
+    // Opens or creates `path` and maps its first `size` bytes. Existing
+    // contents are kept: a shorter file is zero-extended, a longer one is
+    // never truncated. A new file starts zeroed.
+    SaveFile(const std::string& path, size_t size);
+    ~SaveFile();
+
+    SaveFile(const SaveFile&) = delete;
+    SaveFile& operator=(const SaveFile&) = delete;
+
+    uint8_t* Data() { return data; }
+    size_t Size() const { return size; }
+    bool IsMapped() const { return mapped; }
+
+    // Called on every write through the slow path; lock-free.
+    void MarkDirty(size_t offset) { dirty.fetch_or(uint64_t(1) << (offset / chunkSize), std::memory_order_relaxed); }
+    // Chunks written back so far, for diagnostics.
+    uint64_t GetFlushCount() const { return flushes.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int FLUSH_INTERVAL_MS = 1000;
+
+    void FlushDirty();
+    void WriterLoop();
+
+    std::string path;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t chunkSize = 4096;    // a multiple of the host page size, at most 64 chunks
+    bool mapped = false;
+    int fd = -1;
+    std::vector<uint8_t> buffer;    // backing store when not mapped
+
+    std::atomic<uint64_t> dirty{0};
+    std::atomic<uint64_t> flushes{0};
+
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Background/window line kernels. A line is a run of tile rows from the
+// tile cache (one colour index per pixel): `draw` starts `fine` pixels
+// into the first row, maps each index through a 4-entry palette and writes
+// `count` shades (count <= 160, fine < 8, so at most 21 rows). `expand`
+// turns shades into 32-bit pixels for display.
+struct ScanlineKernel {
+    using DrawFn = void (*)(uint8_t* out, int count, const uint8_t* const* rows, int fine, const uint8_t* shades);
+    using ExpandFn = void (*)(uint32_t* out, const uint8_t* shades, int count, const uint32_t* colors);
+
+    const char* name;
+    DrawFn draw;
+    ExpandFn expand;
+
+    // The kernels this host can run, scalar first.
+    static std::vector<ScanlineKernel> Available();
+    // The fastest of them, picked from CPUID once.
+    static const ScanlineKernel& Best();
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Timed hardware events. Each type has at most one pending occurrence.
+enum class EventType : uint8_t {
+    PPUMode,        // end of the current OAM/DRAW/HBLANK/VBLANK period
+    TimerOverflow,  // TIMA wraps and reloads from TMA
+    DMA,            // OAM DMA finishes (or moves its next byte, GB_ACCURATE_DMA)
+    Count
+};
+
+// Pending events keyed by absolute T-cycle. The CPU advances the clock as it
+// executes; Gameboy::RunCycles runs it up to the next deadline and then
+// dispatches whatever became due.
+// There are only a handful of event types, so each has a fixed deadline
+// slot and the earliest one is cached: NextDeadline, which is checked on
+// every slice, is a load rather than a heap operation.
+class Scheduler{
+public:
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    uint64_t Now() const { return now; }
+    void Advance(uint32_t cycles) { now += cycles; }
+
+    // Posts `type` at absolute cycle `when`, replacing any pending event of that type.
+    void Schedule(EventType type, uint64_t when);
+    void Cancel(EventType type);
+    bool IsScheduled(EventType type) const { return deadlines[Index(type)] != NEVER; }
+
+    // Earliest pending deadline, or NEVER when nothing is scheduled.
+    uint64_t NextDeadline() const { return next; }
+    // Removes the earliest event due at or before Now(). Returns false if none is.
+    bool PopDue(EventType& type);
+
+private:
+    friend class Recompiler;    // advances `now` from generated code
+
+    static constexpr size_t EVENT_TYPES = static_cast<size_t>(EventType::Count);
+    static size_t Index(EventType type) { return static_cast<size_t>(type); }
+
+    uint64_t now = 0;
+    uint64_t next = NEVER;
+    std::array<uint64_t, EVENT_TYPES> deadlines = MakeIdle();
+
+    static constexpr std::array<uint64_t, EVENT_TYPES> MakeIdle()
+    {
+        std::array<uint64_t, EVENT_TYPES> idle{};
+        idle.fill(NEVER);
+        return idle;
+    }
+    void UpdateNext();
+};
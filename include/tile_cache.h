@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// The 384 tiles of VRAM tile data (8000-97FF) decoded to one byte per pixel
+// (colour index 0-3). Gameboy's write path keeps it in step with VRAM one
+// row at a time, so the renderers read 8 ready indices instead of
+// recombining two bit planes for every pixel.
+class TileCache{
+public:
+    static constexpr int TILE_COUNT = 384;
+    static constexpr uint16_t TILE_DATA_SIZE = TILE_COUNT * 16;
+
+    // Re-decodes the row holding VRAM byte `offset` (0000-17FF).
+    void Update(const uint8_t* vram, uint16_t offset);
+    // Re-decodes everything, e.g. after VRAM was replaced by a snapshot.
+    void Rebuild(const uint8_t* vram);
+
+    // Row `y` of `tile`, leftmost pixel first.
+    const uint8_t* Row(uint16_t tile, uint8_t y) const { return &pixels[tile * 64 + y * 8]; }
+    // The same row as a mask of its non-zero pixels, bit x for pixel x.
+    uint8_t Opaque(uint16_t tile, uint8_t y) const { return opaque[tile * 8 + y]; }
+
+    // Rows decoded since construction.
+    uint64_t GetUpdateCount() const { return updates; }
+
+private:
+    void DecodeRow(const uint8_t* vram, uint16_t row);
+
+    alignas(64) std::array<uint8_t, TILE_COUNT * 64> pixels{};
+    std::array<uint8_t, TILE_COUNT * 8> opaque{};
+    uint64_t updates = 0;
+};
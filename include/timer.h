@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include "machine_state.h"
+
+class Gameboy;
+
+// DIV/TIMA/TMA/TAC (FF04-FF07). Nothing is ticked per instruction: DIV is
+// derived from the scheduler clock, TIMA is brought up to date when it is
+// accessed, and the overflow is posted to the scheduler so the interrupt
+// is raised on time.
+class Timer{
+public:
+    Timer(Gameboy& gb, Scheduler& scheduler);
+    uint8_t Read(uint16_t addr);
+    void Write(uint16_t addr, uint8_t value);
+    void OnOverflowEvent();
+    // Sets the full 16-bit divider (DIV is its high byte).
+    void SetDivider(uint16_t counter);
+
+private:
+    Gameboy& gb;
+    Scheduler& scheduler;
+
+    TimerState& state;
+
+    bool Enabled() const { return (state.tac & 0x04) != 0; }
+    uint32_t Period() const;
+    void Sync();
+    void ScheduleOverflow();
+};
@@ -1,100 +1,309 @@
 #include <cartridge.h>
+#include "save_file.h"
 #include <stdexcept>
-#include <iostream>
+#include <chrono>
+#include <algorithm>
 
-void Cartridge::Load(const std::vector<uint8_t>& data)
+static int64_t HostSeconds()
 {
-    if (data.size() < 0x150) {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+Cartridge::Cartridge(MBCState& state) : state(state)
+{
+    state = MBCState();
+    state.romBank = 1;
+    state.rtcLatchPrev = 0xFF;
+}
+
+void Cartridge::Load(std::shared_ptr<const RomImage> data)
+{
+    if (data->Size() < 0x150) {
         throw std::runtime_error("ROM file too small to be a valid Game Boy cartridge.");
     }
 
-    rom = data;
+    image = std::move(data);
+    rom = image->Data();
+    romSize = image->Size();
 
     ParseHeader();
     AllocateRAM();
+
+    state = MBCState();
+    state.romBank = 1;
+    state.rtcLatchPrev = 0xFF;
+    romBankCount = static_cast<uint16_t>(std::max<size_t>(2, (romSize + 0x3FFF) / 0x4000));
+    state.rtcBase = HostSeconds();
 }
 
 void Cartridge::ParseHeader()
 {
-    // Extract title (0x0134 - 0x0143)
-    title.clear();
-    for (int i = 0x0134; i <= 0x0143; i++) {
-        if (rom[i] == 0) break;
-        title.push_back(static_cast<char>(rom[i]));
-    }
-
-    // Cartridge type (0x0147)
-    uint8_t type = rom[0x0147];
-
-    hasBattery = false;
-
-    switch (type) {
-        case 0x00: mbcType = MBCType::None; break;
-
-        case 0x01: mbcType = MBCType::MBC1; break;
-        case 0x02: mbcType = MBCType::MBC1; break;
-        case 0x03: mbcType = MBCType::MBC1; hasBattery = true; break;
-
-        case 0x05: mbcType = MBCType::MBC2; break;
-        case 0x06: mbcType = MBCType::MBC2; hasBattery = true; break;
-
-        case 0x0F: mbcType = MBCType::MBC3; hasBattery = true; break;
-        case 0x10: mbcType = MBCType::MBC3; hasBattery = true; break;
-        case 0x11: mbcType = MBCType::MBC3; break;
-        case 0x12: mbcType = MBCType::MBC3; break;
-        case 0x13: mbcType = MBCType::MBC3; hasBattery = true; break;
-
-        case 0x19: mbcType = MBCType::MBC5; break;
-        case 0x1A: mbcType = MBCType::MBC5; break;
-        case 0x1B: mbcType = MBCType::MBC5; hasBattery = true; break;
-        case 0x1C: mbcType = MBCType::MBC5; break;
-        case 0x1D: mbcType = MBCType::MBC5; break;
-        case 0x1E: mbcType = MBCType::MBC5; hasBattery = true; break;
-
-        default:
-            mbcType = MBCType::Unknown;
-            break;
-    }
-
-    // ROM size (0x0148)
-    uint8_t romSizeCode = rom[0x0148];
-    switch (romSizeCode) {
-        case 0x00: romSizeBytes = 32 * 1024; break;
-        case 0x01: romSizeBytes = 64 * 1024; break;
-        case 0x02: romSizeBytes = 128 * 1024; break;
-        case 0x03: romSizeBytes = 256 * 1024; break;
-        case 0x04: romSizeBytes = 512 * 1024; break;
-        case 0x05: romSizeBytes = 1024 * 1024; break;
-        case 0x06: romSizeBytes = 2 * 1024 * 1024; break;
-        case 0x07: romSizeBytes = 4 * 1024 * 1024; break;
-        case 0x08: romSizeBytes = 8 * 1024 * 1024; break;
-        default:
-            romSizeBytes = rom.size(); // fallback
-            break;
-    }
-
-    // RAM size (0x0149)
-    uint8_t ramCode = rom[0x0149];
-    switch (ramCode) {
-        case 0x00: ramSizeBytes = 0; break;
-        case 0x01: ramSizeBytes = 2 * 1024; break;
-        case 0x02: ramSizeBytes = 8 * 1024; break;
-        case 0x03: ramSizeBytes = 32 * 1024; break;
-        case 0x04: ramSizeBytes = 128 * 1024; break;
-        case 0x05: ramSizeBytes = 64 * 1024; break;
-        default:
-            ramSizeBytes = 0;
-            break;
-    }
-
-    std::cout << "Cartridge loaded: " << title << "\n";
-    std::cout << "MBC: " << (int)type << " (" << (int)ramCode << " RAM code)\n";
-    std::cout << "ROM size: " << romSizeBytes / 1024 << " KB\n";
-    std::cout << "RAM size: " << ramSizeBytes / 1024 << " KB\n";
+    CartridgeHeader::Bytes bytes;
+    std::copy_n(rom + CartridgeHeader::START, bytes.size(), bytes.begin());
+    header = CartridgeHeader::Parse(bytes);
+
+    mbcType = header.mbcType;
+    hasBattery = header.hasBattery;
+    hasRTC = header.hasRTC;
+    // An unknown size code falls back to the file size
+    romSizeBytes = header.romSizeBytes != 0 ? header.romSizeBytes : static_cast<uint32_t>(romSize);
+    ramSizeBytes = header.ramSizeBytes;
 }
 
 void Cartridge::AllocateRAM()
 {
-    if (ramSizeBytes > 0)
-        ram.resize(ramSizeBytes);
+    // MBC2 has 512 x 4 bits built in and declares no RAM in the header
+    if (mbcType == MBCType::MBC2)
+        ramSizeBytes = 512;
+
+    ram = PagedRAM(ramSizeBytes);
+}
+
+Cartridge::~Cartridge()
+{
+    delete save;
+}
+
+void Cartridge::OpenSaveFile(const std::string& path)
+{
+    if (!hasBattery || ramSizeBytes == 0) {
+        return;
+    }
+
+    delete save;
+    save = new SaveFile(path, ramSizeBytes);
+    ram = PagedRAM(save->Data(), ramSizeBytes);
+}
+
+void Cartridge::ForkFrom(const Cartridge& parent)
+{
+    delete save;
+    save = nullptr;
+
+    image = parent.image;
+    rom = parent.rom;
+    romSize = parent.romSize;
+    ram = parent.ram.Fork();
+    header = parent.header;
+    mbcType = parent.mbcType;
+    hasBattery = parent.hasBattery;
+    hasRTC = parent.hasRTC;
+    romBankCount = parent.romBankCount;
+    romSizeBytes = parent.romSizeBytes;
+    ramSizeBytes = parent.ramSizeBytes;
+}
+
+void Cartridge::RestoreRAM(const PagedRAM& from)
+{
+    ram.Assign(from);
+    if (save != nullptr) {
+        for (size_t offset = 0; offset < ramSizeBytes; offset += PagedRAM::PAGE_SIZE) {
+            save->MarkDirty(offset);
+        }
+    }
+}
+
+bool Cartridge::WriteRegister(uint16_t addr, uint8_t data)
+{
+    switch (mbcType) {
+    case MBCType::MBC1:
+        if (addr <= 0x1FFF) {
+            state.ramEnabled = (data & 0x0F) == 0x0A;
+        } else if (addr <= 0x3FFF) {
+            state.romBank = (data & 0x1F) == 0 ? 1 : (data & 0x1F);
+        } else if (addr <= 0x5FFF) {
+            state.ramBank = data & 0x03;
+        } else {
+            state.bankingMode = data & 0x01;
+        }
+        return true;
+
+    case MBCType::MBC2:
+        // Address bit 8 selects between RAM enable and the ROM bank
+        if (addr <= 0x3FFF) {
+            if (addr & 0x0100) {
+                state.romBank = (data & 0x0F) == 0 ? 1 : (data & 0x0F);
+            } else {
+                state.ramEnabled = (data & 0x0F) == 0x0A;
+            }
+            return true;
+        }
+        return false;
+
+    case MBCType::MBC3:
+        if (addr <= 0x1FFF) {
+            state.ramEnabled = (data & 0x0F) == 0x0A;
+        } else if (addr <= 0x3FFF) {
+            state.romBank = (data & 0x7F) == 0 ? 1 : (data & 0x7F);
+        } else if (addr <= 0x5FFF) {
+            state.ramBank = data;
+        } else {
+            // Writing 0 then 1 copies the running clock into the registers
+            if (hasRTC && state.rtcLatchPrev == 0x00 && data == 0x01) {
+                SplitRTC(RTCSeconds(), state.rtcLatched);
+            }
+            state.rtcLatchPrev = data;
+            return false;
+        }
+        return true;
+
+    case MBCType::MBC5:
+        if (addr <= 0x1FFF) {
+            state.ramEnabled = (data & 0x0F) == 0x0A;
+        } else if (addr <= 0x2FFF) {
+            state.romBank = (state.romBank & 0x100) | data;
+        } else if (addr <= 0x3FFF) {
+            state.romBank = (state.romBank & 0xFF) | ((data & 0x01) << 8);
+        } else if (addr <= 0x5FFF) {
+            state.ramBank = data & 0x0F;
+        } else {
+            return false;
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+uint16_t Cartridge::GetROMBank0() const
+{
+    if (mbcType == MBCType::MBC1 && state.bankingMode) {
+        return (state.ramBank << 5) % romBankCount;
+    }
+    return 0;
+}
+
+uint16_t Cartridge::GetROMBank() const
+{
+    switch (mbcType) {
+    case MBCType::MBC1:
+        return ((state.ramBank << 5) | state.romBank) % romBankCount;
+    case MBCType::MBC2:
+    case MBCType::MBC3:
+    case MBCType::MBC5:
+        return state.romBank % romBankCount;
+    default:
+        return 1;
+    }
+}
+
+bool Cartridge::IsRAMMapped() const
+{
+    if (ramSizeBytes == 0) {
+        return false;
+    }
+    switch (mbcType) {
+    case MBCType::None:
+        return true;
+    case MBCType::MBC1:
+    case MBCType::MBC5:
+        return state.ramEnabled;
+    case MBCType::MBC3:
+        return state.ramEnabled && state.ramBank <= 0x07;
+    default:
+        return false;
+    }
+}
+
+size_t Cartridge::GetRAMBankOffset() const
+{
+    size_t banks = std::max<size_t>(1, ramSizeBytes / 0x2000);
+    switch (mbcType) {
+    case MBCType::MBC1:
+        return state.bankingMode ? (state.ramBank % banks) * 0x2000 : 0;
+    case MBCType::MBC3:
+    case MBCType::MBC5:
+        return (state.ramBank % banks) * 0x2000;
+    default:
+        return 0;
+    }
+}
+
+uint8_t Cartridge::ReadRAM(uint16_t addr)
+{
+    if (!state.ramEnabled && mbcType != MBCType::None) {
+        return 0xFF;
+    }
+
+    if (mbcType == MBCType::MBC2) {
+        return 0xF0 | ram.Read(addr & 0x01FF);
+    }
+
+    if (mbcType == MBCType::MBC3 && state.ramBank >= 0x08 && state.ramBank <= 0x0C) {
+        return hasRTC ? state.rtcLatched[state.ramBank - 0x08] : 0xFF;
+    }
+
+    size_t offset = GetRAMBankOffset() + (addr - 0xA000);
+    return offset < ramSizeBytes ? ram.Read(offset) : 0xFF;
+}
+
+bool Cartridge::WriteRAM(uint16_t addr, uint8_t data)
+{
+    if (!state.ramEnabled && mbcType != MBCType::None) {
+        return false;
+    }
+
+    if (mbcType == MBCType::MBC2) {
+        ram.Write(addr & 0x01FF, data & 0x0F);
+        if (save != nullptr) { save->MarkDirty(addr & 0x01FF); }
+        return false;
+    }
+
+    if (mbcType == MBCType::MBC3 && state.ramBank >= 0x08 && state.ramBank <= 0x0C) {
+        if (hasRTC) {
+            WriteRTC(state.ramBank - 0x08, data);
+        }
+        return false;
+    }
+
+    size_t offset = GetRAMBankOffset() + (addr - 0xA000);
+    if (offset >= ramSizeBytes) {
+        return false;
+    }
+    bool copied = ram.IsShared(offset / PagedRAM::PAGE_SIZE);
+    ram.Write(offset, data);
+    if (save != nullptr) { save->MarkDirty(offset); }
+    return copied;
+}
+
+int64_t Cartridge::RTCSeconds() const
+{
+    return state.rtcHalted ? state.rtcHaltedAt : HostSeconds() - state.rtcBase;
+}
+
+void Cartridge::SplitRTC(int64_t seconds, uint8_t regs[5]) const
+{
+    int64_t days = seconds / 86400;
+    regs[0] = seconds % 60;
+    regs[1] = (seconds / 60) % 60;
+    regs[2] = (seconds / 3600) % 24;
+    regs[3] = days & 0xFF;
+    regs[4] = ((days >> 8) & 0x01) | (state.rtcHalted ? 0x40 : 0x00)
+            | ((state.rtcCarry || days > 511) ? 0x80 : 0x00);
+}
+
+void Cartridge::WriteRTC(uint8_t reg, uint8_t data)
+{
+    uint8_t regs[5];
+    int64_t now = RTCSeconds();
+    SplitRTC(now, regs);
+    if (now / 86400 > 511) {
+        state.rtcCarry = true;
+    }
+
+    regs[reg] = data;
+    if (reg == 4) {
+        state.rtcCarry = data & 0x80;
+    }
+
+    // Re-express the edited fields as a counter value and rebase on it
+    int64_t days = ((regs[4] & 0x01) << 8) | regs[3];
+    int64_t seconds = ((days * 24 + regs[2]) * 60 + regs[1]) * 60 + regs[0];
+    bool halt = (reg == 4) ? (data & 0x40) : state.rtcHalted;
+
+    state.rtcHalted = halt;
+    state.rtcHaltedAt = seconds;
+    state.rtcBase = HostSeconds() - seconds;
 }
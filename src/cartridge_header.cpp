@@ -0,0 +1,83 @@
+#include "cartridge_header.h"
+#include <cstddef>
+
+CartridgeHeader CartridgeHeader::Parse(const Bytes& bytes)
+{
+    // Header fields by absolute address
+    auto at = [&bytes](uint16_t addr) { return bytes[addr - START]; };
+
+    CartridgeHeader header;
+
+    // Title (0x0134 - 0x0143)
+    for (uint16_t i = 0x0134; i <= 0x0143; i++) {
+        if (at(i) == 0) break;
+        header.title.push_back(static_cast<char>(at(i)));
+    }
+
+    // Cartridge type (0x0147)
+    header.type = at(0x0147);
+    switch (header.type) {
+        case 0x00: header.mbcType = MBCType::None; break;
+
+        case 0x01: header.mbcType = MBCType::MBC1; break;
+        case 0x02: header.mbcType = MBCType::MBC1; break;
+        case 0x03: header.mbcType = MBCType::MBC1; header.hasBattery = true; break;
+
+        case 0x05: header.mbcType = MBCType::MBC2; break;
+        case 0x06: header.mbcType = MBCType::MBC2; header.hasBattery = true; break;
+
+        case 0x0F: header.mbcType = MBCType::MBC3; header.hasBattery = true; header.hasRTC = true; break;
+        case 0x10: header.mbcType = MBCType::MBC3; header.hasBattery = true; header.hasRTC = true; break;
+        case 0x11: header.mbcType = MBCType::MBC3; break;
+        case 0x12: header.mbcType = MBCType::MBC3; break;
+        case 0x13: header.mbcType = MBCType::MBC3; header.hasBattery = true; break;
+
+        case 0x19: header.mbcType = MBCType::MBC5; break;
+        case 0x1A: header.mbcType = MBCType::MBC5; break;
+        case 0x1B: header.mbcType = MBCType::MBC5; header.hasBattery = true; break;
+        case 0x1C: header.mbcType = MBCType::MBC5; break;
+        case 0x1D: header.mbcType = MBCType::MBC5; break;
+        case 0x1E: header.mbcType = MBCType::MBC5; header.hasBattery = true; break;
+
+        default:
+            header.mbcType = MBCType::Unknown;
+            break;
+    }
+
+    // ROM size (0x0148): 32 KB << code
+    uint8_t romSizeCode = at(0x0148);
+    header.romSizeBytes = (romSizeCode <= 0x08) ? (32 * 1024) << romSizeCode : 0;
+
+    // RAM size (0x0149)
+    switch (at(0x0149)) {
+        case 0x01: header.ramSizeBytes = 2 * 1024; break;
+        case 0x02: header.ramSizeBytes = 8 * 1024; break;
+        case 0x03: header.ramSizeBytes = 32 * 1024; break;
+        case 0x04: header.ramSizeBytes = 128 * 1024; break;
+        case 0x05: header.ramSizeBytes = 64 * 1024; break;
+        default:   header.ramSizeBytes = 0; break;
+    }
+
+    // Header checksum (0x014D): x = x - byte - 1 over 0x0134-0x014C
+    uint8_t sum = 0;
+    for (uint16_t i = 0x0134; i <= 0x014C; i++) {
+        sum = sum - at(i) - 1;
+    }
+    header.headerChecksum = at(0x014D);
+    header.headerValid = (sum == header.headerChecksum);
+
+    header.globalChecksum = static_cast<uint16_t>((at(0x014E) << 8) | at(0x014F));
+    return header;
+}
+
+uint16_t CartridgeHeader::GlobalSum(const uint8_t* data, size_t size, size_t offset)
+{
+    uint16_t sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        size_t addr = offset + i;
+        if (addr != 0x014E && addr != 0x014F) {
+            sum += data[i];
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,118 @@
+#include "decode_cache.h"
+#include "gameboy.h"
+#include <algorithm>
+
+DecodeCache::DecodeCache(Gameboy& gb) : gb(gb)
+{
+
+}
+
+// WRAM (C000-DFFF) followed by HRAM (FF80-FFFE), or -1 for anything else.
+static int RAMIndex(uint16_t addr)
+{
+    if (addr >= 0xC000 && addr <= 0xDFFF) {
+        return addr - 0xC000;
+    }
+    if (addr >= 0xFF80 && addr <= 0xFFFE) {
+        return 0x2000 + (addr - 0xFF80);
+    }
+    return -1;
+}
+
+DecodeCache::Entry* DecodeCache::Slot(uint16_t addr)
+{
+    if (addr <= 0x7FFF) {
+        // MBC1 can map a bank other than 0 at 0x0000, so both halves are
+        // looked up by the bank currently mapped there.
+        uint16_t bank = (addr <= 0x3FFF) ? gb.GetROMBank0() : gb.GetROMBank();
+        if (bank >= romBanks.size()) {
+            romBanks.resize(bank + 1);
+        }
+        if (romBanks[bank].empty()) {
+            romBanks[bank].resize(0x4000);
+        }
+        return &romBanks[bank][addr & 0x3FFF];
+    }
+
+    int index = RAMIndex(addr);
+    if (index < 0) {
+        return nullptr;
+    }
+    // Most programs never run from RAM, so the entries are only allocated
+    // the first time they do.
+    if (ram.empty()) {
+        ram.resize(RAM_ENTRIES);
+    }
+    return &ram[index];
+}
+
+const DecodeCache::Entry* DecodeCache::Lookup(uint16_t addr)
+{
+    // During OAM DMA the CPU fetches 0xFF outside HRAM: neither serve nor
+    // store entries until the bus is back.
+    if (addr < 0xFF00 && gb.IsDMAActive()) {
+        return nullptr;
+    }
+
+    Entry* entry = Slot(addr);
+    if (entry == nullptr) {
+        return nullptr;
+    }
+
+    if (entry->op != nullptr) {
+        hits++;
+        return entry;
+    }
+
+    uint8_t opcode = gb.ReadMem(addr);
+    const SM83::Opcode* op = (opcode == 0xCB) ? &SM83::opcodeTableCB[gb.ReadMem(addr + 1)] : &SM83::opcodeTable[opcode];
+
+    // Entries are keyed by the bank at the first byte, so an instruction
+    // whose operands lie in the next ROM half (another bank) or outside
+    // WRAM/HRAM is never cached.
+    uint16_t last = static_cast<uint16_t>(addr + std::max<int>(op->length, 1) - 1);
+    bool contained = (addr <= 0x7FFF) ? ((addr ^ last) & 0xC000) == 0 : RAMIndex(last) >= 0;
+    if (!contained) {
+        return nullptr;
+    }
+
+    misses++;
+    entry->op = op;
+    entry->opcodeLength = (opcode == 0xCB) ? 2 : 1;
+    entry->operands[0] = gb.ReadMem(addr + entry->opcodeLength);
+    entry->operands[1] = gb.ReadMem(addr + entry->opcodeLength + 1);
+    return entry;
+}
+
+size_t DecodeCache::GetAllocatedBytes() const
+{
+    size_t bytes = romBanks.capacity() * sizeof(std::vector<Entry>) + ram.capacity() * sizeof(Entry);
+    for (const std::vector<Entry>& bank : romBanks) {
+        bytes += bank.capacity() * sizeof(Entry);
+    }
+    return bytes;
+}
+
+void DecodeCache::Flush()
+{
+    for (std::vector<Entry>& bank : romBanks) {
+        std::fill(bank.begin(), bank.end(), Entry());
+    }
+    std::fill(ram.begin(), ram.end(), Entry());
+}
+
+void DecodeCache::Invalidate(uint16_t addr)
+{
+    if (ram.empty()) {
+        return;
+    }
+    // An instruction is at most three bytes long (opcode plus a word; CB
+    // opcodes are two), so a write can only change instructions starting up
+    // to two bytes earlier.
+    for (int back = 0; back <= 2; back++) {
+        int index = RAMIndex(static_cast<uint16_t>(addr - back));
+        if (index >= 0) {
+            ram[index].op = nullptr;
+        }
+    }
+}
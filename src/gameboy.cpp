@@ -2,97 +2,731 @@
 #include "ppu.h"
 #include "sm83.h"
 #include "cartridge.h"
-#include <fstream>
+#include "decode_cache.h"
+#include "timer.h"
+#include "rom_image.h"
 #include <vector>
 #include <cstdint>
 #include <stdexcept>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+
+Gameboy::Gameboy() : Gameboy(nullptr)
+{
+
+}
 
-Gameboy::Gameboy()
+Gameboy::Gameboy(MachineState* arena)
+    : state(arena != nullptr ? new (arena) MachineState() : new MachineState()),
+      ownsState(arena == nullptr),
+      scheduler(state->scheduler)
 {
     ppu = new PPU(*this);
     cpu = new SM83(*this);
-    cartridge = new Cartridge();
+    cartridge = new Cartridge(state->mbc);
+    timer = new Timer(*this, scheduler);
+    MapIO();
+    FastBoot();
+    MapPages();
 }
 
-void Gameboy::LoadCartridgeFromFile(const char* filepath){
+Gameboy::~Gameboy()
+{
+    // Deleting the cartridge writes back any battery save still pending.
+    delete timer;
+    delete cartridge;
+    delete cpu;
+    delete ppu;
+    if (ownsState) {
+        delete state;
+    }
+}
+
+Gameboy* Gameboy::Clone()
+{
+    Gameboy* child = new Gameboy();
+    *child->state = *state;
+    child->wram = wram.Fork();
+    child->cartridge->ForkFrom(*cartridge);
+    child->bootROM = bootROM;
+    // Host-side settings, so the child runs the way its parent does.
+    child->cpuPath = cpuPath;
+    child->cpu->SetTrace(cpu->IsTracing());
+    child->SetRenderInterval(GetRenderInterval());
+    child->MapPages();
+    child->ppu->RebuildCaches();
+
+    // Our cartridge RAM pages are shared now: writes must copy them first.
+    // MapPages rather than MapCartridge, so a running DMA keeps the bus.
+    MapPages();
+    return child;
+}
+
+void Gameboy::SaveState(Snapshot& out)
+{
+    out.state = *state;
+    out.wram = wram.Fork();
+    out.cartRAM = cartridge->GetRAM().Fork();
+    MapPages();
+}
+
+void Gameboy::LoadState(const Snapshot& in)
+{
+    *state = in.state;
+    wram = in.wram.Fork();
+    cartridge->RestoreRAM(in.cartRAM);
+    MapPages();
+    ppu->RebuildCaches();
+    cpu->FlushCode();
+}
+
+// DMG IO registers at the hand-over to the cartridge (PC = 0100). Registers
+// owned by a component (timer, LCDC, STAT) are pushed through it.
+static constexpr std::array<uint8_t, 0x80> POST_BOOT_IO = [] {
+    std::array<uint8_t, 0x80> io{};
+    io[0x00] = 0xCF; io[0x02] = 0x7E; io[0x07] = 0xF8; io[0x0F] = 0xE1;
+    io[0x10] = 0x80; io[0x11] = 0xBF; io[0x12] = 0xF3; io[0x13] = 0xFF; io[0x14] = 0xBF;
+    io[0x16] = 0x3F; io[0x18] = 0xFF; io[0x19] = 0xBF;
+    io[0x1A] = 0x7F; io[0x1B] = 0xFF; io[0x1C] = 0x9F; io[0x1D] = 0xFF; io[0x1E] = 0xBF;
+    io[0x20] = 0xFF; io[0x23] = 0xBF; io[0x24] = 0x77; io[0x25] = 0xF3; io[0x26] = 0xF1;
+    io[0x40] = 0x91; io[0x41] = 0x85; io[0x46] = 0xFF; io[0x47] = 0xFC;
+    return io;
+}();
 
+void Gameboy::FastBoot()
+{
+    CPUState& regs = state->cpu;
+    regs.a.Set(0x01);
+    regs.f.Set(0xB0);
+    regs.bc = 0x0013;
+    regs.de = 0x00D8;
+    regs.hl = 0x014D;
+    regs.sp.Set(0xFFFE);
+    regs.pc.Set(0x0100);
+
+    state->io = POST_BOOT_IO;
+    state->ie = 0x00;
+    state->bootROMMapped = false;
+
+    ppu->WriteControl(POST_BOOT_IO[0x40]);
+    ppu->WriteSTAT(POST_BOOT_IO[0x41]);
+    for (uint16_t addr = 0xFF05; addr <= 0xFF07; addr++) {
+        timer->Write(addr, POST_BOOT_IO[addr & 0x7F]);
+    }
+    timer->SetDivider(0xABCC);
+    state->io[0x0F] &= 0x1F;
+}
+
+void Gameboy::LoadBootROM(const char* filepath)
+{
     std::ifstream file(filepath, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error(std::string("Failed to open ROM file: ") + filepath);
+    if (!file.read(reinterpret_cast<char*>(bootROM.data()), bootROM.size())) {
+        throw std::runtime_error(std::string("Failed to read boot ROM: ") + filepath);
     }
 
-    // Read file into buffer
-    std::vector<uint8_t> romData(
-        (std::istreambuf_iterator<char>(file)),
-        (std::istreambuf_iterator<char>())
-    );
+    // Back to power-on: the boot ROM sets up everything it needs itself.
+    state->cpu = CPUState();
+    state->io.fill(0);
+    state->ie = 0x00;
+    ppu->WriteControl(0x00);
+    ppu->WriteSTAT(0x00);
+    timer->SetDivider(0);
+    state->bootROMMapped = true;
+    MapPages();
+    cpu->FlushCode();
+}
 
-    if (romData.empty()) {
-        throw std::runtime_error("ROM file is empty or unreadable.");
-    }
+void Gameboy::LoadCartridgeFromFile(const char* filepath){
+
+    // Mapped (or read once) and shared with any other instance already
+    // running this file; the cartridge only holds a reference.
+    std::shared_ptr<const RomImage> image = RomImage::Open(filepath);
 
-    if (romData.size() < 32768) {
+    if (image->Size() < 32768) {
         std::cerr << "Warning: ROM is unusually small (" 
-                  << romData.size() << " bytes)\n";
+                  << image->Size() << " bytes)\n";
     }
 
-    cartridge->Load(romData);
+    cartridge->Load(image);
+    const CartridgeHeader& header = cartridge->GetHeader();
+    std::cout << "Cartridge loaded: " << header.title << "\n";
+    std::cout << "MBC: " << (int)header.type << (header.headerValid ? "" : " (bad header checksum)") << "\n";
+    std::cout << "ROM size: " << header.romSizeBytes / 1024 << " KB\n";
+    std::cout << "RAM size: " << header.ramSizeBytes / 1024 << " KB\n";
+    cartridge->OpenSaveFile(std::filesystem::path(filepath).replace_extension(".sav").string());
+    MapPages();
 
     std::cout << "Loaded ROM: " << filepath 
-              << " (" << romData.size() << " bytes)" << std::endl;
+              << " (" << image->Size() << " bytes, "
+              << (image->IsMapped() ? "mapped" : "buffered") << " in "
+              << image->GetLoadTime() * 1000.0 << " ms, shared by "
+              << image.use_count() - 1 << " instance(s))" << std::endl;
+    std::cout << "Instance memory: " << GetInstanceMemory() / 1024 << " KB (excluding the shared ROM)" << std::endl;
+}
+
+size_t Gameboy::GetInstanceMemory() const
+{
+    // The tile cache is a member of PPU, so sizeof(PPU) covers it.
+    return sizeof(MachineState) + sizeof(Gameboy) + sizeof(PPU) + sizeof(SM83)
+         + sizeof(Cartridge) + sizeof(Timer) + cpu->GetCodeCacheBytes()
+         + wram.GetPrivateBytes() + cartridge->GetRAM().GetPrivateBytes() + ppu->GetDisplayBufferBytes();
 }
 
 void Gameboy::Boot()
 {
     std::cout << "test" << std::endl;
-    uint8_t cpuCycles;
-    while(!cpu->IsHalted()){
-        cpuCycles = cpu->Tick();
+    while(!cpu->IsLocked()){
+        RunFrame();
     }
-    ppu->Tick(cpuCycles);
     // int STEPS = 10;
     // for(int i = 0; i < STEPS; i++){
     //     cpu.Tick();
     // }
 }
 
-uint8_t Gameboy::ReadMem(uint16_t addr)
+uint32_t Gameboy::RunCPU(uint32_t cycles)
+{
+    switch(cpuPath){
+        case CPUPath::Recompiled: return cpu->RunRecompiled(cycles);
+        case CPUPath::Threaded: return cpu->Run(cycles);
+        case CPUPath::Table: break;
+    }
+    uint32_t elapsed = 0;
+    while(elapsed < cycles && !cpu->IsHalted() && !cpu->IsYielding()){
+        elapsed += cpu->Tick();
+    }
+    return elapsed;
+}
+
+uint32_t Gameboy::RunCycles(uint32_t cycles)
+{
+    uint64_t start = scheduler.Now();
+    uint64_t target = start + cycles;
+
+    while(scheduler.Now() < target){
+        // Interrupts only become due through events, which end a slice, or
+        // through EI and IE/IF writes, which make the CPU return early.
+        cpu->ServiceInterrupts();
+        uint64_t deadline = std::min(target, scheduler.NextDeadline());
+        if(deadline > scheduler.Now()){
+            uint32_t slice = static_cast<uint32_t>(deadline - scheduler.Now());
+            if(cpu->IsHalted()){
+                // Nothing can wake the CPU before the next event fires, so
+                // jump straight to it instead of burning cycles.
+                scheduler.Advance(slice);
+                skippedCycles += slice;
+            }else{
+                RunCPU(slice);
+                if(cpu->GetIdlePeriod() != 0){
+                    // Every iteration that starts before the event reads the
+                    // same value, so skip the whole ones and run the rest.
+                    uint64_t left = deadline > scheduler.Now() ? deadline - scheduler.Now() : 0;
+                    uint32_t iterations = static_cast<uint32_t>(left / cpu->GetIdlePeriod());
+                    scheduler.Advance(iterations * cpu->GetIdlePeriod());
+                    skippedIdleLoops += iterations;
+                    cpu->LeaveIdleLoop();
+                }
+            }
+        }
+        DispatchEvents();
+    }
+    return static_cast<uint32_t>(scheduler.Now() - start);
+}
+
+void Gameboy::DispatchEvents()
 {
-    // ROM Bank 0 (0x0000 - 0x3FFF)
-    if (addr <= 0x3FFF) {
-        return cartridge->GetROM()[addr];
+    EventType type;
+    while(scheduler.PopDue(type)){
+        switch(type){
+            case EventType::PPUMode: ppu->OnModeEvent(); break;
+            case EventType::TimerOverflow: timer->OnOverflowEvent(); break;
+            case EventType::DMA: OnDMAEvent(); break;
+            case EventType::Count: break;
+        }
     }
+}
+
+uint32_t Gameboy::RunFrame()
+{
+    uint64_t skippedBefore = skippedCycles;
+    uint64_t loopsBefore = skippedIdleLoops;
+    uint64_t tilesBefore = ppu->GetTileCache().GetUpdateCount();
+    uint32_t ran = RunCycles(ppu->CyclesUntilVBlank());
+    frameSkippedCycles = static_cast<uint32_t>(skippedCycles - skippedBefore);
+    frameSkippedIdleLoops = static_cast<uint32_t>(skippedIdleLoops - loopsBefore);
+    frameTileUpdates = static_cast<uint32_t>(ppu->GetTileCache().GetUpdateCount() - tilesBefore);
+    return ran;
+}
+
+void Gameboy::Benchmark()
+{
+    // Runs the same emulated minute through each dispatch path the way a
+    // frontend drives the machine (RunFrame, so events fire and interrupts
+    // are taken) and reports instructions per second of host time.
+    const int frames = 60 * 60;
+    const CPUPath paths[] = { CPUPath::Table, CPUPath::Threaded, CPUPath::Recompiled };
+    const char* names[] = { "Table dispatch:    ", "Threaded dispatch: ", "Recompiled:        " };
+    CPUPath selected = cpuPath;
+
+    // Every run starts from this: the whole machine, RAM and save data
+    // included, and no decoded code.
+    Snapshot start;
+    SaveState(start);
+    cpu->SetTrace(false);
+
+    for(int path = 0; path < 3; path++){
+        LoadState(start);
+        SetCPUPath(paths[path]);
+        uint64_t before = cpu->GetInstructionCount();
+        uint64_t hits = cpu->GetDecodeCache().GetHits();
+        uint64_t misses = cpu->GetDecodeCache().GetMisses();
 
-    // Switchable ROM Bank (0x4000 - 0x7FFF) NEED TO IMPLEMENT
-    else if (addr >= 0x4000 && addr <= 0x7FFF) {
-        return cartridge->GetROM()[addr];
-        //return rom[addr + (currentRomBank - 1) * 0x4000];
+        uint64_t skipped = 0;
+        uint64_t idleLoops = 0;
+        uint64_t tileUpdates = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for(int frame = 0; frame < frames; frame++){
+            RunFrame();
+            skipped += GetSkippedCycles();
+            idleLoops += GetSkippedIdleLoops();
+            tileUpdates += GetTileUpdates();
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+
+        uint64_t count = cpu->GetInstructionCount() - before;
+        std::cout << names[path]
+                  << count << " instructions, " << frames << " frames in " << seconds.count() << " s ("
+                  << static_cast<uint64_t>(count / seconds.count()) << " instr/s, "
+                  << static_cast<uint64_t>(frames / seconds.count()) << " frames/s)" << std::endl;
+        if(paths[path] == CPUPath::Table){
+            const DecodeCache& cache = cpu->GetDecodeCache();
+            std::cout << "  decode cache: " << cache.GetHits() - hits << " hits, "
+                      << cache.GetMisses() - misses << " misses" << std::endl;
+        }
+        if(paths[path] == selected){
+            std::cout << "  halt skip: " << skipped / frames << " cycles/frame ("
+                      << (100.0 * skipped / (static_cast<double>(frames) * CYCLES_PER_FRAME))
+                      << "% of each frame)" << std::endl;
+            std::cout << "  idle loop skip: " << idleLoops / frames << " iterations/frame" << std::endl;
+            std::cout << "  tile cache: " << static_cast<double>(tileUpdates) / frames
+                      << " row updates/frame" << std::endl;
+        }
     }
+    SetCPUPath(selected);
 
-    // Video RAM (0x8000 - 0x9FFF)
-    else if (addr >= 0x8000 && addr <= 0x9FFF) {
-        return vram[addr - 0x8000];
+    // Background and window lines from the VRAM the run left behind, once
+    // per kernel the host can run.
+    ScanlineKernel selectedKernel = ppu->GetScanlineKernel();
+    for (const ScanlineKernel& kernel : ScanlineKernel::Available()) {
+        ppu->SetScanlineKernel(kernel);
+        std::cout << "Scanline (" << kernel.name << "): " << ppu->TimeScanlines(144 * 1000) << " ns/line, "
+                  << ppu->TimeFrameConversion(1000) / 1000 << " us/frame to RGBA" << std::endl;
     }
+    ppu->SetScanlineKernel(selectedKernel);
 
-    // External RAM (0xA000 - 0xBFFF)
-    else if (addr >= 0xA000 && addr <= 0xBFFF) {
-        return cartridge->GetRAM()[addr - 0xA000]; // Cartridge RAM
+    // RunFrame again with no pixels drawn, as training runs that only read
+    // RAM use it.
+    LoadState(start);
+    uint32_t interval = GetRenderInterval();
+    SetRenderInterval(0);
+    auto begin = std::chrono::steady_clock::now();
+    for(int frame = 0; frame < frames; frame++){
+        RunFrame();
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+    std::cout << "RunFrame, no render: " << frames << " frames in " << seconds.count() << " s ("
+              << static_cast<uint64_t>(frames / seconds.count()) << " frames/s)" << std::endl;
+    SetRenderInterval(interval);
+    LoadState(start);
+    std::cout << "Instance memory after the runs: " << GetInstanceMemory() / 1024 << " KB" << std::endl;
+}
+
+// A 32 KB ROM-only image of NOPs with each piece of code placed at its
+// address, for VerifyInterrupts.
+static std::shared_ptr<const RomImage> TestROM(std::initializer_list<std::pair<uint16_t, std::vector<uint8_t>>> code)
+{
+    std::vector<uint8_t> rom(0x8000, 0x00);
+    for (const auto& [addr, bytes] : code) {
+        std::copy(bytes.begin(), bytes.end(), rom.begin() + addr);
+    }
+    return RomImage::FromBytes(std::move(rom));
+}
+
+bool Gameboy::VerifyInterrupts()
+{
+    // The main program copies the routine at 0200 to HRAM and jumps there.
+    // It starts OAM DMA, requests VBlank and enables interrupts, so the
+    // interrupt is taken mid-transfer: the vector reads 0xFF (RST 38), and
+    // so does 0038 until the bus comes back. Only then does the handler
+    // store 5A to C000, with the stack full of RST return addresses.
+    std::shared_ptr<const RomImage> dma = TestROM({
+        { 0x0038, { 0x3E, 0x5A,                 // LD A,5A
+                    0xEA, 0x00, 0xC0,           // LD (C000),A
+                    0x18, 0xFE } },             // JR -2
+        { 0x0100, { 0x31, 0xFE, 0xFF,           // LD SP,FFFE
+                    0x3E, 0x01, 0xE0, 0xFF,     // IE = VBlank
+                    0x21, 0x80, 0xFF,           // LD HL,FF80
+                    0x11, 0x00, 0x02,           // LD DE,0200
+                    0x06, 0x09,                 // LD B,9
+                    0x1A, 0x13, 0x22, 0x05,     // copy: LD A,(DE); INC DE; LD (HL+),A; DEC B
+                    0x20, 0xFA,                 // JR NZ,copy
+                    0xAF, 0xE0, 0x0F,           // IF = 0
+                    0x3E, 0xC0,                 // LD A,C0
+                    0xC3, 0x80, 0xFF } },       // JP FF80
+        { 0x0200, { 0xE0, 0x46,                 // OAM DMA from C000
+                    0x3E, 0x01, 0xE0, 0x0F,     // IF = VBlank
+                    0xFB,                       // EI
+                    0x18, 0xFE } },             // JR -2
+    });
+
+    // EI with VBlank already requested: the interrupt has to be taken
+    // before the INC B run gets going (hardware runs exactly one instruction
+    // after EI; this emulator none), and the handler stores B to C000.
+    std::vector<uint8_t> latency = { 0x31, 0xFE, 0xFF,         // LD SP,FFFE
+                                     0x3E, 0x01, 0xE0, 0xFF,   // IE = VBlank
+                                     0xE0, 0x0F,               // IF = VBlank
+                                     0x06, 0x00,               // LD B,0
+                                     0xFB };                   // EI
+    latency.insert(latency.end(), 32, 0x04);                   // INC B
+    latency.insert(latency.end(), { 0x18, 0xFE });             // JR -2
+    std::shared_ptr<const RomImage> ei = TestROM({
+        { 0x0040, { 0x78,                       // LD A,B
+                    0xEA, 0x00, 0xC0,           // LD (C000),A
+                    0x18, 0xFE } },             // JR -2
+        { 0x0100, latency },
+    });
+
+    // Same, but the interrupt becomes due through an IE write via HL in the
+    // middle of straight-line code (a recompiled block has to stop there).
+    // The LCD is off, so once the NOPs have run out the slice it had
+    // already been given, no PPU deadline cuts the block short.
+    std::vector<uint8_t> enable = { 0x31, 0xFE, 0xFF,          // LD SP,FFFE
+                                    0xAF, 0xE0, 0x40,          // LCDC = 0
+                                    0x3E, 0x01, 0xE0, 0x0F,    // IF = VBlank
+                                    0xFB };                    // EI (nothing enabled yet)
+    enable.insert(enable.end(), 16, 0x00);                     // NOP
+    enable.insert(enable.end(), { 0x21, 0xFF, 0xFF,            // LD HL,FFFF
+                                  0x06, 0x00,                  // LD B,0
+                                  0x36, 0x01 });               // LD (HL),1: IE = VBlank
+    enable.insert(enable.end(), 8, 0x04);                      // INC B
+    enable.insert(enable.end(), { 0x18, 0xFE });               // JR -2
+    std::shared_ptr<const RomImage> ie = TestROM({
+        { 0x0040, { 0x78, 0xEA, 0x00, 0xC0, 0x18, 0xFE } },
+        { 0x0100, enable },
+    });
+
+    // OAM DMA started through HL, in a straight line of ROM code: the next
+    // fetch already reads 0xFF (RST 38), so none of the INC B after the
+    // store may run. The handler at 0038 stores B once the bus is back.
+    std::vector<uint8_t> lockout = { 0x31, 0xFE, 0xFF,         // LD SP,FFFE
+                                     0xAF, 0xE0, 0x40 };       // LCDC = 0
+    lockout.insert(lockout.end(), 16, 0x00);                   // NOP
+    lockout.insert(lockout.end(), { 0x21, 0x46, 0xFF,          // LD HL,FF46
+                                    0x06, 0x00,                // LD B,0
+                                    0x3E, 0xC0,                // LD A,C0
+                                    0x77 });                   // LD (HL),A: OAM DMA from C000
+    lockout.insert(lockout.end(), 8, 0x04);                    // INC B
+    lockout.insert(lockout.end(), { 0x18, 0xFE });             // JR -2
+    std::shared_ptr<const RomImage> store = TestROM({
+        { 0x0038, { 0x78,                       // LD A,B
+                    0xEA, 0x00, 0xC0,           // LD (C000),A
+                    0x3E, 0x5A,                 // LD A,5A
+                    0xEA, 0x01, 0xC0,           // LD (C001),A
+                    0x18, 0xFE } },             // JR -2
+        { 0x0100, lockout },
+    });
+
+    struct Case {
+        const char* name;
+        std::shared_ptr<const RomImage> rom;
+        bool (*passed)(Gameboy& gb);
+    };
+    const Case cases[] = {
+        { "Interrupt during DMA", dma,
+          [](Gameboy& gb) { return gb.ReadMem(0xC000) == 0x5A && gb.state->cpu.sp.Get() < 0xFFF0; } },
+        { "Interrupt after EI", ei,
+          [](Gameboy& gb) { return gb.state->cpu.pc.Get() < 0x0100 && gb.ReadMem(0xC000) <= 1; } },
+        { "Interrupt after IE write", ie,
+          [](Gameboy& gb) { return gb.state->cpu.pc.Get() < 0x0100 && gb.ReadMem(0xC000) == 0; } },
+        { "DMA started through HL", store,
+          [](Gameboy& gb) { return gb.ReadMem(0xC001) == 0x5A && gb.ReadMem(0xC000) == 0; } },
+    };
+
+    const CPUPath paths[] = { CPUPath::Table, CPUPath::Threaded, CPUPath::Recompiled };
+    const char* names[] = { "table", "threaded", "recompiled" };
+    int failures = 0;
+
+    for (const Case& test : cases) {
+        for (int path = 0; path < 3; path++) {
+            Gameboy gb;
+            gb.cpu->SetTrace(false);
+            gb.cartridge->Load(test.rom);
+            gb.MapPages();
+            gb.SetCPUPath(paths[path]);
+            gb.RunCycles(CYCLES_PER_FRAME);
+
+            bool ok = test.passed(gb);
+            std::cout << test.name << " (" << names[path] << "): " << (ok ? "ok" : "FAILED") << std::endl;
+            failures += ok ? 0 : 1;
+        }
+    }
+    return failures == 0;
+}
+
+bool Gameboy::VerifyClone()
+{
+    std::shared_ptr<const RomImage> rom = TestROM({ { 0x0100, { 0x18, 0xFE } } });    // JR -2
+
+    const CPUPath paths[] = { CPUPath::Table, CPUPath::Threaded, CPUPath::Recompiled };
+    const char* names[] = { "table", "threaded", "recompiled" };
+    int failures = 0;
+
+    for (int path = 0; path < 3; path++) {
+        Gameboy gb;
+        gb.cpu->SetTrace(false);
+        gb.cartridge->Load(rom);
+        gb.MapPages();
+        gb.SetCPUPath(paths[path]);
+        gb.SetRenderInterval(4);
+
+        std::unique_ptr<Gameboy> child(gb.Clone());
+        bool ok = child->GetCPUPath() == paths[path] && !child->cpu->IsTracing()
+               && child->GetRenderInterval() == 4;
+        std::cout << "Clone keeps settings (" << names[path] << "): " << (ok ? "ok" : "FAILED") << std::endl;
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0;
+}
+
+void Gameboy::SetRenderInterval(uint32_t interval)
+{
+    ppu->SetRenderInterval(interval);
+}
+
+uint32_t Gameboy::GetRenderInterval() const
+{
+    return ppu->GetRenderInterval();
+}
+
+void Gameboy::MapPages()
+{
+    readPages.fill(nullptr);
+    writePages.fill(nullptr);
+
+    MapCartridge();
+
+    // Tile data (8000-97FF) is written through the PPU's tile cache; the
+    // tile maps are plain storage.
+    for (int page = 0; page < 0x20; page++) {
+        readPages[0x80 + page] = &state->vram[page * 0x100];
+    }
+    for (int page = 0x18; page < 0x20; page++) {
+        writePages[0x80 + page] = &state->vram[page * 0x100];
+    }
+
+    // WRAM and its echo are read directly; writes stay on the slow path
+    // because they invalidate decoded code.
+    for (int page = 0; page < 0x20; page++) {
+        readPages[0xC0 + page] = wram.ReadPage(page);
+    }
+    for (int page = 0; page < 0x1E; page++) {
+        readPages[0xE0 + page] = wram.ReadPage(page);
+    }
+
+    // While OAM DMA runs the CPU can only reach FF00-FFFF: every other page
+    // goes to the slow path, which reads 0xFF and drops writes. Sources
+    // above DFFF read the WRAM echo.
+    if (state->dma.active) {
+        uint8_t source = state->dma.source >= 0xE0 ? state->dma.source - 0x20 : state->dma.source;
+        dmaSource = readPages[source];
+        readPages.fill(nullptr);
+        writePages.fill(nullptr);
+    }
+}
+
+void Gameboy::WriteWRAM(uint16_t offset, uint8_t data)
+{
+    // The page may have just been copied: point reads at the copy.
+    size_t page = offset / PagedRAM::PAGE_SIZE;
+    uint8_t* bytes = wram.WritePage(page);
+    bytes[offset % PagedRAM::PAGE_SIZE] = data;
+    readPages[0xC0 + page] = bytes;
+    if (page < 0x1E) {
+        readPages[0xE0 + page] = bytes;
+    }
+}
+
+void Gameboy::MapCartridge()
+{
+    // Bank switches only retarget pointers into the cartridge's vectors.
+    const uint8_t* rom = cartridge->GetROM();
+    size_t romSize = cartridge->GetROMSize();
+    size_t base0 = static_cast<size_t>(cartridge->GetROMBank0()) * 0x4000;
+    size_t base1 = static_cast<size_t>(cartridge->GetROMBank()) * 0x4000;
+
+    for (int page = 0; page < 0x40; page++) {
+        size_t fixed = base0 + page * 0x100;
+        size_t banked = base1 + page * 0x100;
+        readPages[page] = (fixed + 0x100 <= romSize) ? &rom[fixed] : nullptr;
+        readPages[0x40 + page] = (banked + 0x100 <= romSize) ? &rom[banked] : nullptr;
+    }
+    if (state->bootROMMapped) {
+        readPages[0x00] = bootROM.data();
+    }
+
+    // Pages still shared with a fork are written through the slow path,
+    // which copies them first.
+    PagedRAM& ram = cartridge->GetRAM();
+    bool mapped = cartridge->IsRAMMapped();
+    bool writable = mapped && !cartridge->HasSaveFile();
+    size_t ramBase = cartridge->GetRAMBankOffset();
+
+    for (int page = 0; page < 0x20; page++) {
+        size_t index = ramBase / PagedRAM::PAGE_SIZE + page;
+        bool inside = index < ram.PageCount();
+        readPages[0xA0 + page] = (mapped && inside) ? ram.ReadPage(index) : nullptr;
+        writePages[0xA0 + page] = (writable && inside) ? ram.OwnedPage(index) : nullptr;
+    }
+}
+
+void Gameboy::MapIO()
+{
+    // Joypad (FF00): only the select lines are writable; no button is ever
+    // pressed, so the input lines read high.
+    ioReads[0x00] = [](Gameboy& gb, uint8_t) -> uint8_t { return 0xCF | (gb.state->io[0x00] & 0x30); };
+    ioWrites[0x00] = [](Gameboy& gb, uint8_t, uint8_t data) { gb.state->io[0x00] = data & 0x30; };
+
+    // Timer (FF04-FF07)
+    for (uint8_t reg = 0x04; reg <= 0x07; reg++) {
+        ioReads[reg] = [](Gameboy& gb, uint8_t reg) { return gb.timer->Read(0xFF00 | reg); };
+        ioWrites[reg] = [](Gameboy& gb, uint8_t reg, uint8_t data) { gb.timer->Write(0xFF00 | reg, data); };
+    }
+
+    // IF (FF0F): five request bits, the rest read as 1
+    ioReads[0x0F] = [](Gameboy& gb, uint8_t) -> uint8_t { return 0xE0 | gb.state->io[0x0F]; };
+    ioWrites[0x0F] = [](Gameboy& gb, uint8_t, uint8_t data) {
+        gb.state->io[0x0F] = data & 0x1F;
+        gb.cpu->CheckInterrupts();
+    };
+
+    // LCDC, STAT and LY (FF40, FF41, FF44) live in the PPU
+    ioReads[0x40] = [](Gameboy& gb, uint8_t) { return gb.ppu->GetControl(); };
+    ioWrites[0x40] = [](Gameboy& gb, uint8_t, uint8_t data) { gb.ppu->WriteControl(data); };
+    ioReads[0x41] = [](Gameboy& gb, uint8_t) { return gb.ppu->ReadSTAT(gb.state->io[0x45]); };
+    ioWrites[0x41] = [](Gameboy& gb, uint8_t, uint8_t data) { gb.ppu->WriteSTAT(data); };
+    ioReads[0x44] = [](Gameboy& gb, uint8_t) { return gb.ppu->GetLY(); };
+    ioWrites[0x44] = [](Gameboy&, uint8_t, uint8_t) {};
+
+    // OAM DMA (FF46)
+    ioWrites[0x46] = [](Gameboy& gb, uint8_t, uint8_t data) { gb.StartDMA(data); };
+
+    // Boot ROM disable (FF50): a non-zero write unmaps the overlay for good.
+    // Code decoded from the overlay is stale from then on.
+    ioReads[0x50] = [](Gameboy&, uint8_t) -> uint8_t { return 0xFF; };
+    ioWrites[0x50] = [](Gameboy& gb, uint8_t, uint8_t data) {
+        if (data != 0 && gb.state->bootROMMapped) {
+            gb.state->bootROMMapped = false;
+            gb.MapPages();
+            gb.cpu->FlushCode();
+        }
+    };
+}
+
+void Gameboy::StartDMA(uint8_t source)
+{
+    state->io[0x46] = source;
+    state->dma.start = scheduler.Now();
+    state->dma.active = true;
+    state->dma.source = source;
+    state->dma.next = 0;
+    MapPages();
+    // From here on code fetches see the locked bus, and the transfer may end
+    // before the current slice would: return to RunCycles, so neither a
+    // recompiled block nor the slice runs on past this store.
+    cpu->Yield();
+
+#if defined(GB_ACCURATE_DMA)
+    scheduler.Schedule(EventType::DMA, state->dma.start + 4);
+#else
+    // Most games copy the same shadow OAM every frame; only a change
+    // costs a sprite list rebuild.
+    std::array<uint8_t, 0xA0> copy;
+    if (dmaSource != nullptr) {
+        std::memcpy(copy.data(), dmaSource, copy.size());
+    } else {
+        copy.fill(0xFF);
+    }
+    if (copy != state->oam) {
+        state->oam = copy;
+        ppu->InvalidateSprites();
+    }
+    state->dma.next = static_cast<uint8_t>(state->oam.size());
+    scheduler.Schedule(EventType::DMA, state->dma.start + 4 * state->oam.size());
+#endif
+}
+
+void Gameboy::OnDMAEvent()
+{
+#if defined(GB_ACCURATE_DMA)
+    uint8_t i = state->dma.next++;
+    uint8_t data = dmaSource != nullptr ? dmaSource[i] : 0xFF;
+    if (state->oam[i] != data) {
+        state->oam[i] = data;
+        ppu->InvalidateSprites();
+    }
+    if (state->dma.next < state->oam.size()) {
+        scheduler.Schedule(EventType::DMA, state->dma.start + 4 * (state->dma.next + 1));
+        return;
     }
+#endif
+    state->dma.active = false;
+    dmaSource = nullptr;
+    MapPages();
+}
 
-    // Work RAM (0xC000 - 0xDFFF)
-    else if (addr >= 0xC000 && addr <= 0xDFFF) {
-        return wram[addr - 0xC000];
+uint16_t Gameboy::GetROMBank0() const
+{
+    return cartridge->GetROMBank0();
+}
+
+uint16_t Gameboy::GetROMBank() const
+{
+    return cartridge->GetROMBank();
+}
+
+uint8_t Gameboy::ReadSlow(uint16_t addr)
+{
+    // IO Registers (0xFF00 - 0xFF7F), the most frequent slow-path access
+    if (addr >= 0xFF00 && addr <= 0xFF7F) {
+        IORead handler = ioReads[addr & 0x7F];
+        return handler != nullptr ? handler(*this, addr & 0x7F) : state->io[addr & 0x7F];
     }
 
-    // Echo RAM (0xE000 - 0xFDFF)
-    else if (addr >= 0xE000 && addr <= 0xFDFF) {
-        return wram[addr - 0xE000]; // Mirrors C000-DDFF
+    // Everything below FF00 is cut off while OAM DMA holds the bus
+    else if (state->dma.active && addr < 0xFF00) {
+        return 0xFF;
+    }
+
+    // ROM pages the image doesn't cover read as open bus
+    else if (addr <= 0x7FFF) {
+        return 0xFF;
+    }
+
+    // External RAM (0xA000 - 0xBFFF) that isn't plain banked RAM
+    else if (addr >= 0xA000 && addr <= 0xBFFF) {
+        return cartridge->ReadRAM(addr);
     }
 
     // OAM (0xFE00 - 0xFE9F)
     else if (addr >= 0xFE00 && addr <= 0xFE9F) {
-        return oam[addr - 0xFE00];
+        return state->oam[addr - 0xFE00];
     }
 
     // Unusable memory (0xFEA0 - 0xFEFF)
@@ -100,67 +734,83 @@ uint8_t Gameboy::ReadMem(uint16_t addr)
         return 0xFF; // Or open bus behavior
     }
 
-    // IO Registers (0xFF00 - 0xFF7F)
-    else if (addr >= 0xFF00 && addr <= 0xFF7F) {
-        return io[addr - 0xFF00];
-    }
-
     // High RAM (0xFF80 - 0xFFFE)
     else if (addr >= 0xFF80 && addr <= 0xFFFE) {
-        return hram[addr - 0xFF80];
+        return state->hram[addr - 0xFF80];
     }
 
     // Interrupt Enable Register (0xFFFF)
     else if (addr == 0xFFFF) {
-        return ie;
+        return state->ie;
     }
 
     // Default fallback
     return 0xFF;
 }
 
-void Gameboy::WriteMem(uint16_t addr, uint8_t data)
+void Gameboy::WriteSlow(uint16_t addr, uint8_t data)
 {
+    // I/O Registers (0xFF00–0xFF7F)
+    if (addr >= 0xFF00 && addr <= 0xFF7F)
+    {
+        IOWrite handler = ioWrites[addr & 0x7F];
+        if (handler != nullptr) { handler(*this, addr & 0x7F, data); } else { state->io[addr & 0x7F] = data; }
+        return;
+    }
+
+    // Everything below FF00 is cut off while OAM DMA holds the bus
+    if (state->dma.active && addr < 0xFF00)
+    {
+        return;
+    }
+
     // ROM (0x0000–0x7FFF)
     // Cannot be written directly — writes go to the MBC controller
-    // if (addr <= 0x7FFF)
-    // {
-    //     cartridge.HandleWrite(addr, data);  // You must implement banking logic here
-    //     return;
-    // }
+    if (addr <= 0x7FFF)
+    {
+        if (cartridge->WriteRegister(addr, data)) { MapCartridge(); }
+        return;
+    }
 
-    // Video RAM (0x8000–0x9FFF)
-    if (addr >= 0x8000 && addr <= 0x9FFF)
+    // Tile data (0x8000–0x97FF)
+    if (addr >= 0x8000 && addr <= 0x97FF)
     {
-        vram[addr - 0x8000] = data;
+        ppu->WriteTileData(addr - 0x8000, data);
         return;
     }
 
     // External RAM (0xA000–0xBFFF)
-    // if (addr >= 0xA000 && addr <= 0xBFFF)
-    // {
-    //     cartridge.WriteRAM(addr - 0xA000, data); // MBC-controlled RAM
-    //     return;
-    // }
+    if (addr >= 0xA000 && addr <= 0xBFFF)
+    {
+        if (cartridge->WriteRAM(addr, data)) { MapCartridge(); }
+        return;
+    }
 
     // Work RAM (0xC000–0xDFFF)
     if (addr >= 0xC000 && addr <= 0xDFFF)
     {
-        wram[addr - 0xC000] = data;
+        WriteWRAM(addr - 0xC000, data);
+        cpu->InvalidateCode(addr);
+        if (addr <= 0xDDFF) { cpu->InvalidateCode(addr + 0x2000); }
         return;
     }
 
     // Echo RAM (0xE000–0xFDFF) mirrors C000–DDFF
     if (addr >= 0xE000 && addr <= 0xFDFF)
     {
-        wram[addr - 0xE000] = data;
+        WriteWRAM(addr - 0xE000, data);
+        cpu->InvalidateCode(addr);
+        cpu->InvalidateCode(addr - 0x2000);
         return;
     }
 
     // OAM (0xFE00–0xFE9F)
     if (addr >= 0xFE00 && addr <= 0xFE9F)
     {
-        oam[addr - 0xFE00] = data;
+        if (state->oam[addr - 0xFE00] != data) {
+            state->oam[addr - 0xFE00] = data;
+            ppu->InvalidateSprites();
+        }
         return;
     }
 
@@ -171,24 +821,19 @@ void Gameboy::WriteMem(uint16_t addr, uint8_t data)
         return;
     }
 
-    // I/O Registers (0xFF00–0xFF7F)
-    if (addr >= 0xFF00 && addr <= 0xFF7F)
-    {
-        io[addr - 0xFF00] = data;
-        return;
-    }
-
     // High RAM (0xFF80–0xFFFE)
     if (addr >= 0xFF80 && addr <= 0xFFFE)
     {
-        hram[addr - 0xFF80] = data;
+        state->hram[addr - 0xFF80] = data;
+        cpu->InvalidateCode(addr);
         return;
     }
 
     // Interrupt Enable (0xFFFF)
     if (addr == 0xFFFF)
     {
-        ie = data;
+        state->ie = data;
+        cpu->CheckInterrupts();
         return;
     }
 }
\ No newline at end of file
@@ -1,13 +1,54 @@
 #include "gameboy.h"
+#include "sm83.h"
+#include "rom_library.h"
+#include <chrono>
+#include <filesystem>
 #include <iostream>
+#include <string>
 
 int main(int argc, char* argv[]){
     Gameboy gb;
-    if(argc != 2){
-        std::cout << "ROM filepath not provided: gameboy_emu.exe <filepath>" << std::endl;
+    if(argc > 1 && std::string(argv[1]) == "--verify-flags"){
+        return SM83::VerifyLazyFlags() ? 0 : 1;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--verify-interrupts"){
+        return Gameboy::VerifyInterrupts() ? 0 : 1;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--verify-clone"){
+        return Gameboy::VerifyClone() ? 0 : 1;
+    }
+    if(argc > 2 && std::string(argv[1]) == "--index"){
+        // Header index of a ROM directory, cached next to the ROMs
+        bool verify = argc > 3 && std::string(argv[3]) == "--verify";
+        RomLibrary library;
+        auto start = std::chrono::steady_clock::now();
+        library.Scan(argv[2], (std::filesystem::path(argv[2]) / ".romindex").string(), verify);
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        for(const RomLibrary::Entry& entry : library.GetEntries()){
+            const CartridgeHeader& header = entry.header;
+            std::cout << entry.path << ": \"" << header.title << "\" type " << (int)header.type
+                      << ", " << header.romSizeBytes / 1024 << " KB ROM, " << header.ramSizeBytes / 1024 << " KB RAM"
+                      << (header.headerValid ? "" : ", bad header checksum")
+                      << (entry.globalChecked && !entry.globalValid ? ", bad global checksum" : "") << std::endl;
+        }
+        std::cout << library.GetEntries().size() << " ROMs (" << library.GetParsedCount() << " parsed, "
+                  << library.GetReusedCount() << " from the index) in " << seconds.count() * 1000.0 << " ms" << std::endl;
+        return 0;
+    }
+    if(argc < 2){
+        std::cout << "ROM filepath not provided: gameboy_emu.exe <filepath> [--bench | --boot-rom <dmg_boot.bin>]" << std::endl;
+        std::cout << "                   gameboy_emu.exe --index <directory> [--verify]" << std::endl;
+        return 1;
     }
 
     gb.LoadCartridgeFromFile(argv[1]);
-    gb.Boot();
+    if(argc > 3 && std::string(argv[2]) == "--boot-rom"){
+        gb.LoadBootROM(argv[3]);
+    }
+    if(argc > 2 && std::string(argv[2]) == "--bench"){
+        gb.Benchmark();
+    }else{
+        gb.Boot();
+    }
     return 0;
 }
\ No newline at end of file
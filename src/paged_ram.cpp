@@ -0,0 +1,80 @@
+#include "paged_ram.h"
+#include <algorithm>
+
+static const std::shared_ptr<std::array<uint8_t, PagedRAM::PAGE_SIZE>>& ZeroPage()
+{
+    // Never written: this reference keeps it shared.
+    static const auto zero = std::make_shared<std::array<uint8_t, PagedRAM::PAGE_SIZE>>();
+    return zero;
+}
+
+PagedRAM::PagedRAM(size_t size) : pages((size + PAGE_SIZE - 1) / PAGE_SIZE, ZeroPage()), size(size)
+{
+
+}
+
+PagedRAM::PagedRAM(uint8_t* memory, size_t size)
+    : snapshots((size + PAGE_SIZE - 1) / PAGE_SIZE), size(size), external(true)
+{
+    // Aliasing pointers with no owner: the memory is not freed here.
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        pages.emplace_back(std::shared_ptr<Page>(), reinterpret_cast<Page*>(memory + offset));
+    }
+}
+
+PagedRAM PagedRAM::Fork() const
+{
+    PagedRAM fork;
+    fork.size = size;
+    if (!external) {
+        fork.pages = pages;
+        return fork;
+    }
+
+    fork.pages.reserve(pages.size());
+    for (size_t page = 0; page < pages.size(); page++) {
+        if (snapshots[page] == nullptr) {
+            snapshots[page] = std::make_shared<Page>(*pages[page]);
+        }
+        fork.pages.push_back(snapshots[page]);
+    }
+    return fork;
+}
+
+uint8_t* PagedRAM::WritePage(size_t page)
+{
+    if (external) {
+        // Forks keep their reference to the snapshot.
+        snapshots[page].reset();
+    } else if (IsShared(page)) {
+        pages[page] = std::make_shared<Page>(*pages[page]);
+    }
+    return pages[page]->data();
+}
+
+void PagedRAM::Assign(const PagedRAM& other)
+{
+    size_t count = std::min(pages.size(), other.pages.size());
+    for (size_t page = 0; page < count; page++) {
+        if (!external && !other.external) {
+            pages[page] = other.pages[page];
+        } else if (!external || snapshots[page] != other.pages[page]) {
+            // (A live snapshot equal to the source means the mapping already
+            // holds these bytes.)
+            std::copy(other.pages[page]->begin(), other.pages[page]->end(), WritePage(page));
+        }
+    }
+}
+
+size_t PagedRAM::GetPrivateBytes() const
+{
+    size_t count = 0;
+    for (size_t page = 0; page < pages.size(); page++) {
+        if (external) {
+            count += snapshots[page] != nullptr ? 2 * PAGE_SIZE : PAGE_SIZE;
+        } else {
+            count += IsShared(page) ? 0 : PAGE_SIZE;
+        }
+    }
+    return count;
+}
@@ -1,76 +1,350 @@
 #include "ppu.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
 
-PPU::PPU(Gameboy& gb) : gb(gb)
+PPU::PPU(Gameboy& gb) : gb(gb), state(gb.GetState().ppu), vram(gb.GetState().vram), io(gb.GetState().io), oam(gb.GetState().oam)
 {
+    state = PPUState();
+    state.mode = OAM;
+    state.control.Set(0x91);    // the PPU starts running, so the display is on
 
+    state.modeEnd = gb.GetScheduler().Now();
+    ScheduleModeEnd(80);
 }
 
-void PPU::Tick(int cyc)
+void PPU::ScheduleModeEnd(uint32_t duration)
 {
-    cycles += cyc;
+    // Chained from the previous deadline, not from now, so a late dispatch
+    // doesn't drift the frame.
+    state.modeEnd += duration;
+    gb.GetScheduler().Schedule(EventType::PPUMode, state.modeEnd);
+}
 
-    switch (mode) {
+void PPU::OnModeEvent()
+{
+    switch (state.mode) {
     case OAM:
-        if (cyc >= 80) {
-            cycles -= 80;
-            mode = DRAW;
-        }
+        if (RendersFrame()) { ScanOAM(); }
+        state.mode = DRAW;
+        ScheduleModeEnd(172);
         break;
 
     case DRAW:
-        if (cycles >= 172) {
-            cycles -= 172;
-            DrawScanline();
-            mode = HBLANK;
-        }
+        DrawScanline();
+        state.mode = HBLANK;
+        ScheduleModeEnd(204);
         break;
 
     case HBLANK:
-        if (cycles >= 204) {
-            cycles -= 204;
-            ly++;
-            if (ly == 144) {
-                mode = VBLANK;
-            } else {
-                mode = OAM;
-            }
+        state.ly++;
+        if (state.ly == 144) {
+            state.mode = VBLANK;
+            state.frames++;
+            gb.RequestInterrupt(0);
+            ScheduleModeEnd(456);
+        } else {
+            state.mode = OAM;
+            ScheduleModeEnd(80);
         }
         break;
 
     case VBLANK:
-        if (cycles >= 456) {
-            cycles -= 456;
-            ly++;
-            if (ly > 153) {
-                ly = 0;
-                mode = OAM;
-            }
+        state.ly++;
+        if (state.ly > 153) {
+            state.ly = 0;
+            state.windowLine = 0;
+            state.mode = OAM;
+            ScheduleModeEnd(80);
+        } else {
+            ScheduleModeEnd(456);
         }
         break;
     }
 }
 
-void PPU::DrawBackgroundLine()
+void PPU::WriteControl(uint8_t value)
+{
+    bool wasOn = DisplayEnabled();
+    state.control.Set(value);
+
+    if (wasOn && !DisplayEnabled()) {
+        state.ly = 0;
+        state.mode = HBLANK;
+        gb.GetScheduler().Cancel(EventType::PPUMode);
+    } else if (!wasOn && DisplayEnabled()) {
+        state.mode = OAM;
+        state.windowLine = 0;
+        state.modeEnd = gb.GetScheduler().Now();
+        ScheduleModeEnd(80);
+    }
+}
+
+void PPU::WriteTileData(uint16_t offset, uint8_t data)
+{
+    if (vram[offset] != data) {
+        vram[offset] = data;
+        tiles.Update(vram.data(), offset);
+    }
+}
+
+uint8_t PPU::ReadSTAT(uint8_t lyc) const
+{
+    return 0x80 | state.status.Get() | (state.ly == lyc ? 0x04 : 0x00) | state.mode;
+}
+
+uint32_t PPU::CyclesUntilVBlank() const
+{
+    const uint32_t LINE = 456;
+
+    // With the display off there is no VBlank; a frame is just its length.
+    if (!check_bit(state.control.Get(), 7)) { return CYCLES_PER_FRAME; }
+
+    uint64_t now = gb.GetScheduler().Now();
+    uint32_t left = (state.modeEnd > now) ? static_cast<uint32_t>(state.modeEnd - now) : 0;
+
+    switch (state.mode) {
+    case OAM:    return left + 172 + 204 + (143 - state.ly) * LINE;
+    case DRAW:   return left + 204 + (143 - state.ly) * LINE;
+    case HBLANK: return left + (143 - state.ly) * LINE;
+    case VBLANK: return left + (153 - state.ly) * LINE + 144 * LINE;
+    }
+    return 0;
+}
+
+// Sets pixels x to x+7 of `mask` from the low byte of `bits`, clipped to
+// the line.
+static void Place(LineMask& mask, uint32_t bits, int x)
+{
+    if (x < 0) { bits >>= -x; x = 0; }
+    if (x >= 160) { return; }
+
+    int shift = x & 63;
+    mask.w[x >> 6] |= static_cast<uint64_t>(bits) << shift;
+    if (shift > 56) { mask.w[(x >> 6) + 1] |= bits >> (64 - shift); }
+    mask.w[2] &= 0xFFFFFFFF;
+}
+
+// Clears pixels x to 159.
+static void ClearFrom(LineMask& mask, int x)
+{
+    for (int w = 0; w < 3; w++) {
+        int first = x - w * 64;
+        if (first <= 0) {
+            mask.w[w] = 0;
+        } else if (first < 64) {
+            mask.w[w] &= (uint64_t(1) << first) - 1;
+        }
+    }
+}
+
+static uint8_t Reverse(uint8_t bits)
+{
+    bits = static_cast<uint8_t>((bits & 0xF0) >> 4 | (bits & 0x0F) << 4);
+    bits = static_cast<uint8_t>((bits & 0xCC) >> 2 | (bits & 0x33) << 2);
+    return static_cast<uint8_t>((bits & 0xAA) >> 1 | (bits & 0x55) << 1);
+}
+
+void PPU::FetchRows(const uint8_t** rows, uint8_t* masks, int count, uint16_t map, uint8_t column, uint8_t y)
+{
+    for (int t = 0; t < count; t++) {
+        uint8_t index = vram[map + ((column + t) & 31)];
+        // LCDC bit 4 clear: signed tile numbers relative to 9000
+        uint16_t tile = BackgroundWindowTile() ? index : static_cast<uint16_t>(256 + static_cast<int8_t>(index));
+        rows[t] = tiles.Row(tile, y & 7);
+        masks[t] = tiles.Opaque(tile, y & 7);
+    }
+}
+
+void PPU::DrawBackgroundLine(const uint8_t* shades, LineMask& opaque)
 {
-    bool use_tile_set_zero = WindowTileMap();
-    bool use_tile_map_zero = !BackgroundTileMap();
+    uint8_t y = io[0x42] + state.ly;    // SCY
+    uint8_t scx = io[0x43];
+    uint16_t map = (BackgroundTileMap() ? 0x1C00 : 0x1800) + (y >> 3) * 32;
 
-    for(unsigned int x = 0; x < GAMEBOY_WIDTH; x++)
-    {
+    const uint8_t* rows[21];
+    uint8_t masks[21];
+    FetchRows(rows, masks, 21, map, scx >> 3, y);
+    kernel.draw(&frameBuffer[state.ly * GAMEBOY_WIDTH], GAMEBOY_WIDTH, rows, scx & 7, shades);
 
+    for (int t = 0; t < 21; t++) {
+        Place(opaque, masks[t], t * 8 - (scx & 7));
     }
 }
 
-void PPU::DrawWindowLine()
+void PPU::DrawWindowLine(const uint8_t* shades, LineMask& opaque)
 {
+    if (!WindowOnLine()) { return; }
+    uint8_t wx = io[0x4B];
+
+    // WX is the left edge plus 7; below 7 the window starts off screen.
+    int start = wx < 7 ? 0 : wx - 7;
+    int fine = wx < 7 ? 7 - wx : 0;
+    int count = GAMEBOY_WIDTH - start;
+    int tileCount = (count + fine + 7) >> 3;
+    uint16_t map = (WindowTileMap() ? 0x1C00 : 0x1800) + (state.windowLine >> 3) * 32;
 
+    const uint8_t* rows[21];
+    uint8_t masks[21];
+    FetchRows(rows, masks, tileCount, map, 0, state.windowLine);
+    kernel.draw(&frameBuffer[state.ly * GAMEBOY_WIDTH + start], count, rows, fine, shades);
+    state.windowLine++;
+
+    ClearFrom(opaque, start);
+    for (int t = 0; t < tileCount; t++) {
+        Place(opaque, masks[t], start + t * 8 - fine);
+    }
+}
+
+void PPU::ScanOAM()
+{
+    uint8_t height = SpriteSize() ? 16 : 8;
+    if (spritesDirty || height != spriteListHeight) {
+        BuildSpriteLists();
+    }
+}
+
+void PPU::BuildSpriteLists()
+{
+    uint8_t height = SpriteSize() ? 16 : 8;
+    lineSpriteCount.fill(0);
+
+    for (uint8_t i = 0; i < 40; i++) {
+        int top = oam[i * 4] - 16;
+        int first = std::max(top, 0);
+        int last = std::min(top + height, 144);
+        for (int y = first; y < last; y++) {
+            if (lineSpriteCount[y] < MAX_LINE_SPRITES) {
+                lineSprites[y][lineSpriteCount[y]++] = i;
+            }
+        }
+    }
+
+    // Insertion sort by X; stable, so equal X keeps OAM order.
+    for (int y = 0; y < 144; y++) {
+        std::array<uint8_t, MAX_LINE_SPRITES>& list = lineSprites[y];
+        for (int i = 1; i < lineSpriteCount[y]; i++) {
+            uint8_t sprite = list[i];
+            int j = i;
+            for (; j > 0 && oam[list[j - 1] * 4 + 1] > oam[sprite * 4 + 1]; j--) {
+                list[j] = list[j - 1];
+            }
+            list[j] = sprite;
+        }
+    }
+
+    spriteListHeight = height;
+    spritesDirty = false;
+}
+
+void PPU::DrawSpriteLine(const LineMask& background)
+{
+    uint8_t* out = &frameBuffer[state.ly * GAMEBOY_WIDTH];
+    LineMask taken{};
+
+    for (int s = 0; s < lineSpriteCount[state.ly]; s++) {
+        const uint8_t* sprite = &oam[lineSprites[state.ly][s] * 4];
+        int x = sprite[1] - 8;
+        uint8_t flags = sprite[3];
+        bool flipX = (flags & 0x20) != 0;
+
+        uint8_t row = static_cast<uint8_t>(state.ly - (sprite[0] - 16));
+        if (flags & 0x40) { row = spriteListHeight - 1 - row; }
+        uint16_t tile = spriteListHeight == 16 ? (sprite[2] & 0xFE) + (row >> 3) : sprite[2];
+        const uint8_t* pixels = tiles.Row(tile, row & 7);
+        uint8_t opaque = tiles.Opaque(tile, row & 7);
+
+        LineMask cover{};
+        Place(cover, flipX ? Reverse(opaque) : opaque, x);
+
+        // Sprites in front win a pixel even where the background then hides
+        // them, so `taken` grows by the whole coverage.
+        LineMask visible;
+        for (int w = 0; w < 3; w++) {
+            visible.w[w] = cover.w[w] & ~taken.w[w];
+            taken.w[w] |= cover.w[w];
+            if (flags & 0x80) { visible.w[w] &= ~background.w[w]; }
+        }
+
+        uint8_t obp = io[(flags & 0x10) ? 0x49 : 0x48];
+        uint8_t shades[4];
+        for (int i = 0; i < 4; i++) {
+            shades[i] = (obp >> (i * 2)) & 3;
+        }
+
+        for (int w = 0; w < 3; w++) {
+            for (uint64_t bits = visible.w[w]; bits != 0; bits &= bits - 1) {
+                int pixel = w * 64 + std::countr_zero(bits);
+                int i = pixel - x;
+                out[pixel] = shades[pixels[flipX ? 7 - i : i]];
+            }
+        }
+    }
 }
 
 void PPU::DrawScanline()
 {
     if(!DisplayEnabled()) { return; }
 
-    if(BackgroundEnabled()) { DrawBackgroundLine(); }
+    // A skipped frame still counts window lines, so its state matches a
+    // drawn one.
+    if(!RendersFrame()) {
+        if(BackgroundEnabled() && WindowEnabled() && WindowOnLine()) { state.windowLine++; }
+        return;
+    }
+
+    LineMask opaque{};
+
+    // LCDC bit 0 clear blanks the background and the window
+    if(!BackgroundEnabled()) {
+        std::fill_n(&frameBuffer[state.ly * GAMEBOY_WIDTH], GAMEBOY_WIDTH, 0);
+    } else {
+        uint8_t bgp = io[0x47];
+        uint8_t shades[4];
+        for (int i = 0; i < 4; i++) {
+            shades[i] = (bgp >> (i * 2)) & 3;
+        }
+
+        DrawBackgroundLine(shades, opaque);
+
+        if(WindowEnabled()) { DrawWindowLine(shades, opaque); }
+    }
+
+    if(SpritesEnabled()) { DrawSpriteLine(opaque); }
+}
 
-    if(WindowEnabled()) { DrawWindowLine(); }
-}
\ No newline at end of file
+const uint32_t* PPU::GetFrameBuffer()
+{
+    displayBuffer.resize(GAMEBOY_WIDTH * GAMEBOY_HEIGHT);
+    kernel.expand(displayBuffer.data(), frameBuffer, GAMEBOY_WIDTH * GAMEBOY_HEIGHT, displayColors.data());
+    return displayBuffer.data();
+}
+
+double PPU::TimeScanlines(int lines)
+{
+    uint8_t ly = state.ly;
+    uint8_t windowLine = state.windowLine;
+    ScanOAM();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lines; i++) {
+        state.ly = static_cast<uint8_t>(i % GAMEBOY_HEIGHT);
+        if (state.ly == 0) { state.windowLine = 0; }
+        DrawScanline();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    state.ly = ly;
+    state.windowLine = windowLine;
+    return elapsed.count() / lines;
+}
+
+double PPU::TimeFrameConversion(int frames)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        GetFrameBuffer();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
@@ -0,0 +1,478 @@
+#include "recompiler.h"
+#include "sm83.h"
+#include "gameboy.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RECOMPILER_X64 1
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+// Worst case machine code for one block, checked before compiling so a block
+// never runs off the end of the buffer: a handler call with its clock update
+// and early exit is 64 bytes, times 64 instructions, plus entry and exit.
+static const size_t MAX_BLOCK_BYTES = 4096 + 128;
+
+static bool IsCodeRegion(uint16_t addr)
+{
+    return addr <= 0x7FFF
+        || (addr >= 0xC000 && addr <= 0xFDFF)
+        || (addr >= 0xFF80 && addr <= 0xFFFE);
+}
+
+// Control transfers, HALT/STOP, interrupt toggles and IO writes end a
+// block. The interpreter handler decides where execution continues; after
+// an IO write (DMA start, bank or LCD changes) Execute looks again.
+static bool EndsBlock(uint8_t opcode, uint8_t n16hi)
+{
+    switch (opcode) {
+        case 0xE0: case 0xE2:                                       // LDH (n),A; LD (C),A
+            return true;
+        case 0xEA:                                                  // LD (nn),A
+            return n16hi == 0xFF;
+        case 0x10: case 0x76: case 0xF3: case 0xFB:                 // STOP, HALT, DI, EI
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:      // JR
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA:      // JP
+        case 0xE9:                                                  // JP HL
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC:      // CALL
+        case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8:      // RET
+        case 0xD9:                                                  // RETI
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF:                 // RST
+        case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Recompiler::Recompiler(SM83& cpu, Gameboy& gb) : cpu(cpu), gb(gb)
+{
+#ifdef RECOMPILER_X64
+#if defined(_WIN32)
+    buffer = static_cast<uint8_t*>(VirtualAlloc(nullptr, BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+#else
+    void* mem = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buffer = (mem == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(mem);
+#endif
+#endif
+}
+
+Recompiler::~Recompiler()
+{
+#ifdef RECOMPILER_X64
+    if(buffer != nullptr){
+#if defined(_WIN32)
+        VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+        munmap(buffer, BUFFER_SIZE);
+#endif
+    }
+#endif
+}
+
+uint32_t Recompiler::Execute(uint32_t budget)
+{
+    uint16_t addr = cpu.state.pc.Get();
+    // What the CPU fetches during OAM DMA isn't the code: interpret it.
+    if(addr < 0xFF00 && gb.IsDMAActive()){
+        return cpu.Step();
+    }
+    uint32_t key = MakeKey(addr);
+
+    auto it = blocks.find(key);
+    if(it == blocks.end()){
+        Block block;
+        if(!Compile(addr, block)){
+            return cpu.Step();
+        }
+        it = blocks.emplace(key, block).first;
+    }
+
+    // Too long for what is left of the slice: interpret up to its end.
+    if(it->second.cycles > budget){
+        return cpu.Run(budget);
+    }
+
+    // The block advances the clock itself. It may invalidate or flush
+    // itself while it runs, so nothing of it is touched afterwards.
+    uint32_t ran = it->second.code(&cpu);
+    cpu.state.instructions += ran >> 16;
+    return ran & 0xFFFF;
+}
+
+size_t Recompiler::GetAllocatedBytes() const
+{
+    size_t bytes = used + blocks.bucket_count() * sizeof(void*)
+                 + blocks.size() * (sizeof(std::pair<const uint32_t, Block>) + sizeof(void*));
+    for (const std::vector<uint32_t>& page : codePages) {
+        bytes += page.capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+void Recompiler::Invalidate(uint16_t addr)
+{
+    std::vector<uint32_t>& page = codePages[addr >> 8];
+    if(page.empty()){
+        return;
+    }
+
+    // Page granularity: every block touching the written page is dropped.
+    // The machine code itself is only reclaimed by Flush, so a block that
+    // overwrites its own code can still return safely.
+    for(uint32_t key : page){
+        blocks.erase(key);
+    }
+    page.clear();
+}
+
+void Recompiler::Flush()
+{
+    blocks.clear();
+    for(auto& page : codePages){
+        page.clear();
+    }
+    used = 0;
+}
+
+uint32_t Recompiler::MakeKey(uint16_t addr)
+{
+    uint32_t bank = 0;
+    if(addr <= 0x3FFF){
+        bank = gb.GetROMBank0();
+    }else if(addr <= 0x7FFF){
+        bank = gb.GetROMBank();
+    }
+    return (bank << 16) | addr;
+}
+
+template <bool CB, uint8_t N>
+void Recompiler::CallHandler(SM83* cpu, uint32_t next)
+{
+    constexpr SM83::Opcode op = CB ? SM83::opcodeTableCB[N] : SM83::opcodeTable[N];
+    cpu->state.pc.Set(static_cast<uint16_t>(next));
+    if constexpr (op.handler != nullptr) {
+        (cpu->*op.handler)();
+    }
+}
+
+template <bool CB, size_t... N>
+constexpr std::array<Recompiler::HandlerFn, 256> Recompiler::MakeHandlerTable(std::index_sequence<N...>)
+{
+    return {{ &Recompiler::CallHandler<CB, static_cast<uint8_t>(N)>... }};
+}
+
+void Recompiler::ResolveFlags(SM83* cpu)
+{
+    cpu->state.f.Get();
+}
+
+bool Recompiler::Compile(uint16_t addr, Block& block)
+{
+#ifdef RECOMPILER_X64
+    if(!IsAvailable() || !IsCodeRegion(addr)){
+        return false;
+    }
+
+    if(BUFFER_SIZE - used < MAX_BLOCK_BYTES){
+        Flush();
+    }
+
+    static constexpr std::array<HandlerFn, 256> handlers = MakeHandlerTable<false>(std::make_index_sequence<256>());
+    static constexpr std::array<HandlerFn, 256> handlersCB = MakeHandlerTable<true>(std::make_index_sequence<256>());
+
+    // B, C, D, E, H, L, (HL), A in SM83 operand encoding order
+    ByteRegister* regs[8] = { &cpu.state.b, &cpu.state.c, &cpu.state.d, &cpu.state.e, &cpu.state.h, &cpu.state.l, nullptr, &cpu.state.a };
+
+    uint8_t* start = buffer + used;
+    block.code = reinterpret_cast<BlockFn>(start);
+    block.cycles = 0;
+    block.instructions = 0;
+    block.start = addr;
+
+    // rbx addresses the CPU state for native code, r13 keeps the SM83* for
+    // handler calls. push rbx; push r13; sub rsp, 8 (40 on Windows: shadow
+    // space); mov r13, <first argument>; mov rbx, &state
+    Emit8(0x53);
+    Emit8(0x41); Emit8(0x55);
+#if defined(_WIN32)
+    Emit8(0x48); Emit8(0x83); Emit8(0xEC); Emit8(0x28);
+    Emit8(0x49); Emit8(0x89); Emit8(0xCD);
+#else
+    Emit8(0x48); Emit8(0x83); Emit8(0xEC); Emit8(0x08);
+    Emit8(0x49); Emit8(0x89); Emit8(0xFD);
+#endif
+    Emit8(0x48); Emit8(0xBB); Emit64(reinterpret_cast<uint64_t>(&cpu.state));
+
+    uint16_t pc = addr;
+    bool ended = false;
+    uint32_t synced = 0;    // cycles of this block already added to the clock
+#ifdef GB_LAZY_FLAGS
+    // SM83 flags the host EFLAGS still hold from the last native ALU op.
+    // Plain moves leave them alone; a handler call clobbers them.
+    enum class HostFlags { None, Z, ZC } host = HostFlags::None;
+#endif
+    for(int i = 0; i < MAX_BLOCK_INSTRUCTIONS && !ended; i++){
+        if(((pc ^ addr) & 0xC000) != 0 || !IsCodeRegion(pc)){
+            break;
+        }
+
+        uint8_t opcode = gb.ReadMem(pc);
+        const SM83::Opcode& op =
+            (opcode == 0xCB)
+            ? SM83::opcodeTableCB[gb.ReadMem(pc + 1)]
+            : SM83::opcodeTable[opcode];
+
+        // An instruction running into the next bank or region would compile
+        // in operand bytes from whatever is mapped there now.
+        uint16_t last = static_cast<uint16_t>(pc + op.length - 1);
+        if(op.handler == nullptr || ((last ^ addr) & 0xC000) != 0 || !IsCodeRegion(last)){
+            if(i == 0){
+                used = start - buffer;
+                return false;
+            }
+            break;
+        }
+        block.instructions++;
+
+        uint8_t cb = gb.ReadMem(pc + 1);
+        uint8_t n8 = cb;
+        uint8_t n16hi = gb.ReadMem(pc + 2);
+        uint8_t dst = (opcode >> 3) & 7;
+        uint8_t src = opcode & 7;
+
+#ifdef GB_LAZY_FLAGS
+        uint8_t alu = (opcode >> 3) & 7;
+        bool aluReg = opcode >= 0x80 && opcode <= 0xBF && src != 6;
+        bool aluImm = opcode >= 0xC0 && (opcode & 7) == 6;
+        bool incDec = opcode < 0x40 && (src == 4 || src == 5) && dst != 6;
+
+        // JR cc / JP cc on flags still in EFLAGS: NZ, Z, NC, C
+        uint8_t cc = (opcode >> 3) & 3;
+        bool jrcc = opcode == 0x20 || opcode == 0x28 || opcode == 0x30 || opcode == 0x38;
+        bool jpcc = opcode == 0xC2 || opcode == 0xCA || opcode == 0xD2 || opcode == 0xDA;
+        bool flagsLive = (cc < 2) ? host != HostFlags::None : host == HostFlags::ZC;
+#ifdef GB_IDLE_LOOP_SKIP
+        // JR cc,-6 may close a polling loop: the handler detects those
+        bool idleCandidate = jrcc && n8 == 0xFA;
+#else
+        bool idleCandidate = false;
+#endif
+        bool nativeBranch = (jrcc || jpcc) && flagsLive && !idleCandidate;
+#endif
+
+        if(opcode == 0x00){
+            // NOP
+        }else if(opcode >= 0x40 && opcode <= 0x7F && opcode != 0x76 && dst != 6 && src != 6){
+            // LD r, r: mov al, [rbx+src]; mov [rbx+dst], al
+            Emit8(0x8A); Emit8(0x83); Emit32(Offset(regs[src]->Data()));
+            Emit8(0x88); Emit8(0x83); Emit32(Offset(regs[dst]->Data()));
+        }else if(opcode < 0x40 && (opcode & 7) == 6 && dst != 6){
+            // LD r, n8: mov byte [rbx+dst], imm8
+            Emit8(0xC6); Emit8(0x83); Emit32(Offset(regs[dst]->Data())); Emit8(n8);
+        }else if(opcode == 0x01 || opcode == 0x11 || opcode == 0x21){
+            // LD BC/DE/HL, n16: two byte stores
+            ByteRegister* hi = regs[(opcode >> 4) * 2];
+            ByteRegister* lo = regs[(opcode >> 4) * 2 + 1];
+            Emit8(0xC6); Emit8(0x83); Emit32(Offset(hi->Data())); Emit8(n16hi);
+            Emit8(0xC6); Emit8(0x83); Emit32(Offset(lo->Data())); Emit8(n8);
+        }else if(opcode == 0x31){
+            // LD SP, n16: mov word [rbx+sp], imm16
+            Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(Offset(cpu.state.sp.Data())); Emit16((n16hi << 8) | n8);
+        }else if(opcode == 0xC3 || opcode == 0x18){
+            // JP nn, JR e: mov word [rbx+pc], target
+            uint16_t target = (opcode == 0xC3) ? ((n16hi << 8) | n8) : pc + 2 + static_cast<int8_t>(n8);
+            Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(Offset(cpu.state.pc.Data())); Emit16(target);
+            ended = true;
+#ifdef GB_LAZY_FLAGS
+        }else if(nativeBranch){
+            // setcc [branched]; pc = fall-through; jump over the next store
+            // unless taken; pc = target
+            static const uint8_t setcc[4] = { 0x95, 0x94, 0x93, 0x92 };     // setne, sete, setae, setb
+            static const uint8_t skip[4] = { 0x74, 0x75, 0x72, 0x73 };      // je, jne, jb, jae
+            uint16_t target = jrcc ? pc + 2 + static_cast<int8_t>(n8) : (n16hi << 8) | n8;
+            Emit8(0x0F); Emit8(setcc[cc]); Emit8(0x83); Emit32(Offset(&cpu.state.branched));
+            Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(Offset(cpu.state.pc.Data())); Emit16(pc + op.length);
+            Emit8(skip[cc]); Emit8(9);
+            Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(Offset(cpu.state.pc.Data())); Emit16(target);
+            ended = true;
+        }else if((aluReg || aluImm) && alu != 1 && alu != 3){
+            // ADD/SUB/AND/XOR/OR/CP A, r or n8 (ADC/SBC read C: handler).
+            // The operation itself, then FlagRegister::Defer's fields.
+            // mov al, [rbx+a]; mov cl, [rbx+src] or mov cl, imm8
+            Emit8(0x8A); Emit8(0x83); Emit32(Offset(cpu.state.a.Data()));
+            if(aluReg){
+                Emit8(0x8A); Emit8(0x8B); Emit32(Offset(regs[src]->Data()));
+            }else{
+                Emit8(0xB1); Emit8(n8);
+            }
+            // Add and Sub record the operands, the logic ops their result
+            static const uint8_t ops[8] = { 0x00, 0, 0x28, 0, 0x20, 0x30, 0x08, 0x28 };
+            static const FlagOp flagOps[8] = { FlagOp::Add, FlagOp::None, FlagOp::Sub, FlagOp::None,
+                                               FlagOp::And, FlagOp::Logic, FlagOp::Logic, FlagOp::Sub };
+            FlagRegister& f = cpu.state.f;
+            if(flagOps[alu] == FlagOp::Add || flagOps[alu] == FlagOp::Sub){
+                Emit8(0x88); Emit8(0x83); Emit32(Offset(&f.pendingLhs));        // mov [lhs], al
+                Emit8(0x88); Emit8(0x8B); Emit32(Offset(&f.pendingRhs));        // mov [rhs], cl
+                Emit8(ops[alu]); Emit8(0xC8);                                   // add/sub al, cl
+            }else{
+                Emit8(ops[alu]); Emit8(0xC8);                                   // and/xor/or al, cl
+                Emit8(0x88); Emit8(0x83); Emit32(Offset(&f.pendingLhs));        // mov [lhs], al
+                Emit8(0xC6); Emit8(0x83); Emit32(Offset(&f.pendingRhs)); Emit8(0);
+            }
+            Emit8(0xC6); Emit8(0x83); Emit32(Offset(&f.pendingCarry)); Emit8(0);
+            Emit8(0xC6); Emit8(0x83); Emit32(Offset(&f.pending)); Emit8(static_cast<uint8_t>(flagOps[alu]));
+            if(alu != 7){
+                Emit8(0x88); Emit8(0x83); Emit32(Offset(cpu.state.a.Data()));   // mov [a], al
+            }
+            host = HostFlags::ZC;
+        }else if(incDec){
+            // INC/DEC r keep C. Right after a native ALU op that is the host
+            // carry (the Inc/Dec flags only take C from F): setc cl;
+            // shl cl, 4; mov [f], cl. Otherwise pending flags are
+            // materialized: cmp byte [pending], 0; je +15; call ResolveFlags
+            FlagRegister& f = cpu.state.f;
+            if(host == HostFlags::ZC){
+                Emit8(0x0F); Emit8(0x92); Emit8(0xC1);
+                Emit8(0xC0); Emit8(0xE1); Emit8(0x04);
+                Emit8(0x88); Emit8(0x8B); Emit32(Offset(&f.val));
+            }else{
+                Emit8(0x80); Emit8(0xBB); Emit32(Offset(&f.pending)); Emit8(0);
+                Emit8(0x74); Emit8(15);
+                EmitCall(reinterpret_cast<const void*>(&ResolveFlags));
+            }
+            // inc/dec byte [rbx+r]; mov al, [rbx+r]; mov [lhs], al
+            Emit8(0xFE); Emit8(src == 4 ? 0x83 : 0x8B); Emit32(Offset(regs[dst]->Data()));
+            Emit8(0x8A); Emit8(0x83); Emit32(Offset(regs[dst]->Data()));
+            Emit8(0x88); Emit8(0x83); Emit32(Offset(&f.pendingLhs));
+            // mov word [rhs], 0 (rhs and carry); mov byte [pending], Inc/Dec
+            Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(Offset(&f.pendingRhs)); Emit16(0);
+            Emit8(0xC6); Emit8(0x83); Emit32(Offset(&f.pending));
+            Emit8(static_cast<uint8_t>(src == 4 ? FlagOp::Inc : FlagOp::Dec));
+            host = HostFlags::Z;
+#endif
+        }else{
+            // Fallback: handler(cpu, address after the opcode bytes). The
+            // clock first catches up to the start of this instruction, so
+            // IO the handler touches sees the right time.
+            EmitAdvance(block.cycles - synced);
+            synced = block.cycles;
+            HandlerFn handler = (opcode == 0xCB) ? handlersCB[cb] : handlers[opcode];
+            uint16_t next = pc + ((opcode == 0xCB) ? 2 : 1);
+#if defined(_WIN32)
+            Emit8(0x4C); Emit8(0x89); Emit8(0xE9);      // mov rcx, r13
+            Emit8(0xBA); Emit32(next);                  // mov edx, next
+#else
+            Emit8(0x4C); Emit8(0x89); Emit8(0xEF);      // mov rdi, r13
+            Emit8(0xBE); Emit32(next);                  // mov esi, next
+#endif
+            Emit8(0x48); Emit8(0xB8); Emit64(reinterpret_cast<uint64_t>(handler));
+            Emit8(0xFF); Emit8(0xD0);                   // call rax
+            ended = (opcode != 0xCB) && EndsBlock(opcode, n16hi);
+#ifdef GB_LAZY_FLAGS
+            host = HostFlags::None;
+#endif
+
+            if(!ended){
+                // A write to IE/IF (even through HL) can make an interrupt
+                // due, which makes the CPU yield: leave with this instruction
+                // done. cmp byte [yield], 0; je over the exit
+                Emit8(0x80); Emit8(0xBB); Emit32(Offset(&cpu.state.yield)); Emit8(0);
+                Emit8(0x74); Emit8(RETURN_BYTES + 11);
+                EmitAdvance(op.cycles);
+                EmitReturn((block.instructions << 16) | (block.cycles + op.cycles));
+            }
+        }
+
+        block.cycles += op.cycles;
+        pc += (opcode == 0xCB) ? 2 : op.length;
+    }
+
+    // Fell through the end of the block: store the next PC ourselves.
+    if(!ended){
+        Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(Offset(cpu.state.pc.Data())); Emit16(pc);
+    }
+    EmitAdvance(block.cycles - synced);
+    EmitReturn((block.instructions << 16) | block.cycles);
+
+    block.end = pc;
+
+    // RAM code is tracked per page so writes through WriteMem can drop it.
+    if(addr >= 0x8000){
+        uint32_t key = MakeKey(addr);
+        for(int page = addr >> 8; page <= ((pc - 1) & 0xFFFF) >> 8; page++){
+            codePages[page].push_back(key);
+        }
+    }
+
+    return true;
+#else
+    (void)addr;
+    (void)block;
+    return false;
+#endif
+}
+
+void Recompiler::EmitCall(const void* fn)
+{
+#if defined(_WIN32)
+    Emit8(0x4C); Emit8(0x89); Emit8(0xE9);      // mov rcx, r13
+#else
+    Emit8(0x4C); Emit8(0x89); Emit8(0xEF);      // mov rdi, r13
+#endif
+    Emit8(0x48); Emit8(0xB8); Emit64(reinterpret_cast<uint64_t>(fn));
+    Emit8(0xFF); Emit8(0xD0);                   // call rax
+}
+
+void Recompiler::EmitAdvance(uint32_t cycles)
+{
+    if(cycles != 0){
+        // add qword [rbx+now], imm32
+        Emit8(0x48); Emit8(0x81); Emit8(0x83); Emit32(Offset(&cpu.scheduler.now)); Emit32(cycles);
+    }
+}
+
+void Recompiler::EmitReturn(uint32_t result)
+{
+    // mov eax, result; add rsp, 8 (40); pop r13; pop rbx; ret
+    Emit8(0xB8); Emit32(result);
+#if defined(_WIN32)
+    Emit8(0x48); Emit8(0x83); Emit8(0xC4); Emit8(0x28);
+#else
+    Emit8(0x48); Emit8(0x83); Emit8(0xC4); Emit8(0x08);
+#endif
+    Emit8(0x41); Emit8(0x5D);
+    Emit8(0x5B);
+    Emit8(0xC3);
+}
+
+void Recompiler::Emit8(uint8_t byte)
+{
+    buffer[used++] = byte;
+}
+
+void Recompiler::Emit16(uint16_t word)
+{
+    Emit8(word & 0xFF);
+    Emit8(word >> 8);
+}
+
+void Recompiler::Emit32(uint32_t dword)
+{
+    Emit16(dword & 0xFFFF);
+    Emit16(dword >> 16);
+}
+
+void Recompiler::Emit64(uint64_t qword)
+{
+    Emit32(qword & 0xFFFFFFFF);
+    Emit32(qword >> 32);
+}
+
+int32_t Recompiler::Offset(const void* field)
+{
+    return static_cast<int32_t>(static_cast<const uint8_t*>(field) - reinterpret_cast<const uint8_t*>(&cpu.state));
+}
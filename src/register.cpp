@@ -1,20 +1,54 @@
 #include "register.h"
 
-void ByteRegister::Set(const uint8_t value){ val = value; }
-void ByteRegister::Increment(){ val += 1; }
-void ByteRegister::Decrement(){ val -= 1; }
+void FlagRegister::Materialize()
+{
+    int lhs = pendingLhs;
+    int rhs = pendingRhs;
+    uint8_t flags = 0;
 
-void WordRegister::Set(const uint16_t value){ val = value;}
-void WordRegister::Increment(){ val += 1; }
-void WordRegister::Decrement(){ val -= 1; }
+    switch (pending) {
+        case FlagOp::Add: {
+            int result = lhs + rhs + pendingCarry;
+            flags = ((result & 0xFF) == 0 ? 0x80 : 0)
+                  | ((lhs ^ rhs ^ result) & 0x10 ? 0x20 : 0)
+                  | (result > 0xFF ? 0x10 : 0);
+            break;
+        }
+        case FlagOp::Sub: {
+            int result = lhs - rhs - pendingCarry;
+            flags = ((result & 0xFF) == 0 ? 0x80 : 0)
+                  | 0x40
+                  | ((lhs ^ rhs ^ result) & 0x10 ? 0x20 : 0)
+                  | (result < 0 ? 0x10 : 0);
+            break;
+        }
+        case FlagOp::Inc:
+            flags = (lhs == 0 ? 0x80 : 0)
+                  | ((lhs & 0x0F) == 0x00 ? 0x20 : 0)
+                  | (val & 0x10);
+            break;
+        case FlagOp::Dec:
+            flags = (lhs == 0 ? 0x80 : 0)
+                  | 0x40
+                  | ((lhs & 0x0F) == 0x0F ? 0x20 : 0)
+                  | (val & 0x10);
+            break;
+        case FlagOp::And:
+            flags = (lhs == 0 ? 0x80 : 0) | 0x20;
+            break;
+        case FlagOp::Logic:
+            flags = (lhs == 0 ? 0x80 : 0);
+            break;
+        case FlagOp::AddSP: {
+            int result = lhs + rhs;
+            flags = ((lhs ^ rhs ^ result) & 0x10 ? 0x20 : 0)
+                  | (result > 0xFF ? 0x10 : 0);
+            break;
+        }
+        case FlagOp::None:
+            return;
+    }
 
-void FlagRegister::Set(const uint8_t value){ val = value & 0xF0; }
-void FlagRegister::SetZero(bool set){ set_bit(7, set); }
-void FlagRegister::SetSubtract(bool set){ set_bit(6, set); }
-void FlagRegister::SetHalfCarry(bool set){ set_bit(5, set); }
-void FlagRegister::SetCarry(bool set){ set_bit(4, set); }
-
-bool FlagRegister::Zero(){ return check_bit(val, 7); }
-bool FlagRegister::Subtract(){ return check_bit(val, 6); }
-bool FlagRegister::HalfCarry(){ return check_bit(val, 5); }
-bool FlagRegister::Carry(){ return check_bit(val, 4); }
\ No newline at end of file
+    val = flags;
+    pending = FlagOp::None;
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "rom_image.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ROM_IMAGE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const RomImage> RomImage::Open(const std::string& path)
+{
+    static std::mutex lock;
+    static std::unordered_map<std::string, std::weak_ptr<const RomImage>> live;
+
+    // Keyed by the resolved path, so every spelling of a file shares one
+    // image. A path that can't be resolved is kept as given; loading it
+    // fails below anyway.
+    std::error_code error;
+    std::filesystem::path resolved = std::filesystem::canonical(path, error);
+    std::string key = error ? path : resolved.string();
+
+    std::lock_guard<std::mutex> guard(lock);
+    // Forget images that every instance has released since the last Open.
+    std::erase_if(live, [](const auto& entry) { return entry.second.expired(); });
+    if (auto found = live.find(key); found != live.end()) {
+        if (std::shared_ptr<const RomImage> image = found->second.lock()) {
+            return image;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<RomImage> image(new RomImage());
+    if (!image->Map(path)) {
+        image->Read(path);
+    }
+    if (image->size == 0) {
+        throw std::runtime_error("ROM file is empty or unreadable.");
+    }
+    image->loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    live[key] = image;
+    return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::FromBytes(std::vector<uint8_t> bytes)
+{
+    std::shared_ptr<RomImage> image(new RomImage());
+    image->buffer = std::move(bytes);
+    image->data = image->buffer.data();
+    image->size = image->buffer.size();
+    return image;
+}
+
+RomImage::~RomImage()
+{
+#ifdef ROM_IMAGE_MMAP
+    if (mapped) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+#endif
+}
+
+bool RomImage::Map(const std::string& path)
+{
+#ifdef ROM_IMAGE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps the file referenced, so the descriptor can go.
+    void* mem = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+
+    data = static_cast<const uint8_t*>(mem);
+    size = static_cast<size_t>(info.st_size);
+    mapped = true;
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void RomImage::Read(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::string("Failed to open ROM file: ") + path);
+    }
+
+    std::streamsize length = file.tellg();
+    if (length <= 0) {
+        return;
+    }
+
+    buffer.resize(static_cast<size_t>(length));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(buffer.data()), length)) {
+        throw std::runtime_error(std::string("Failed to read ROM file: ") + path);
+    }
+
+    data = buffer.data();
+    size = buffer.size();
+}
@@ -0,0 +1,200 @@
+#include "rom_library.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+static bool IsRomFile(const fs::path& path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext == ".gb" || ext == ".gbc";
+}
+
+void RomLibrary::Scan(const std::string& directory, const std::string& indexPath, bool verifyGlobal, unsigned threads)
+{
+    std::unordered_map<std::string, Entry> cached;
+    for (Entry& entry : LoadIndex(indexPath)) {
+        std::string path = entry.path;
+        cached.emplace(std::move(path), std::move(entry));
+    }
+
+    entries.clear();
+    parsed = 0;
+    reused = 0;
+
+    // Walk the directory and take whatever the index still describes.
+    std::vector<size_t> work;
+    std::error_code error;
+    for (fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, error), end;
+         it != end; it.increment(error)) {
+        if (error || !it->is_regular_file(error) || !IsRomFile(it->path())) {
+            continue;
+        }
+
+        Entry entry;
+        entry.path = it->path().string();
+        entry.size = it->file_size(error);
+        entry.mtime = static_cast<int64_t>(it->last_write_time(error).time_since_epoch().count());
+
+        auto hit = cached.find(entry.path);
+        if (hit != cached.end() && hit->second.mtime == entry.mtime && hit->second.size == entry.size
+            && (hit->second.globalChecked || !verifyGlobal)) {
+            entries.push_back(std::move(hit->second));
+            reused++;
+        } else {
+            work.push_back(entries.size());
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    // Parse the rest on a fixed pool; workers claim files one at a time so
+    // a few large ROMs (with verifyGlobal) don't leave the others idle.
+    if (!work.empty()) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = std::min<unsigned>(threads, static_cast<unsigned>(work.size()));
+
+        std::vector<char> ok(entries.size(), 1);
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; t++) {
+            pool.emplace_back([&]() {
+                for (size_t i = next.fetch_add(1); i < work.size(); i = next.fetch_add(1)) {
+                    ok[work[i]] = ReadEntry(entries[work[i]], verifyGlobal);
+                }
+            });
+        }
+        for (std::thread& worker : pool) {
+            worker.join();
+        }
+
+        // Drop files that turned out not to be ROMs
+        size_t kept = 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (ok[i]) {
+                if (kept != i) {
+                    entries[kept] = std::move(entries[i]);
+                }
+                kept++;
+            }
+        }
+        entries.resize(kept);
+        parsed = work.size();
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.path < b.path; });
+
+    if (!work.empty() || reused != cached.size()) {
+        SaveIndex(indexPath);
+    }
+}
+
+bool RomLibrary::ReadEntry(Entry& entry, bool verifyGlobal)
+{
+    std::ifstream file(entry.path, std::ios::binary);
+    if (!file.is_open() || entry.size < CartridgeHeader::START + CartridgeHeader::SIZE) {
+        return false;
+    }
+
+    file.seekg(CartridgeHeader::START);
+    if (!file.read(reinterpret_cast<char*>(entry.headerBytes.data()), entry.headerBytes.size())) {
+        return false;
+    }
+    entry.header = CartridgeHeader::Parse(entry.headerBytes);
+
+    if (verifyGlobal) {
+        std::vector<uint8_t> chunk(64 * 1024);
+        uint16_t sum = 0;
+        size_t offset = 0;
+        file.seekg(0);
+        while (file.read(reinterpret_cast<char*>(chunk.data()), chunk.size()) || file.gcount() > 0) {
+            size_t got = static_cast<size_t>(file.gcount());
+            sum += CartridgeHeader::GlobalSum(chunk.data(), got, offset);
+            offset += got;
+        }
+        entry.globalChecked = true;
+        entry.globalValid = (sum == entry.header.globalChecksum);
+    }
+    return true;
+}
+
+// Index layout (host byte order, it never leaves the machine):
+//   u32 magic, u32 version, u32 count, then per entry
+//   u16 path length, path, i64 mtime, u64 size, u8 flags, 80 header bytes
+template <typename T>
+static void Put(std::ofstream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool Get(std::ifstream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+std::vector<RomLibrary::Entry> RomLibrary::LoadIndex(const std::string& indexPath)
+{
+    std::vector<Entry> loaded;
+    std::ifstream in(indexPath, std::ios::binary);
+    uint32_t magic = 0, version = 0, count = 0;
+    if (!Get(in, magic) || !Get(in, version) || !Get(in, count) || magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        return loaded;
+    }
+
+    loaded.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        Entry entry;
+        uint16_t length = 0;
+        uint8_t flags = 0;
+        if (!Get(in, length)) {
+            break;
+        }
+        entry.path.resize(length);
+        if (!in.read(entry.path.data(), length) || !Get(in, entry.mtime) || !Get(in, entry.size) || !Get(in, flags)
+            || !in.read(reinterpret_cast<char*>(entry.headerBytes.data()), entry.headerBytes.size())) {
+            break;
+        }
+        entry.header = CartridgeHeader::Parse(entry.headerBytes);
+        entry.globalChecked = (flags & 0x01) != 0;
+        entry.globalValid = (flags & 0x02) != 0;
+        loaded.push_back(std::move(entry));
+    }
+    return loaded;
+}
+
+void RomLibrary::SaveIndex(const std::string& indexPath) const
+{
+    // Written aside and renamed, so a crash never leaves a torn index.
+    std::string temp = indexPath + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return;
+        }
+        Put(out, INDEX_MAGIC);
+        Put(out, INDEX_VERSION);
+        Put(out, static_cast<uint32_t>(entries.size()));
+        for (const Entry& entry : entries) {
+            Put(out, static_cast<uint16_t>(entry.path.size()));
+            out.write(entry.path.data(), static_cast<std::streamsize>(entry.path.size()));
+            Put(out, entry.mtime);
+            Put(out, entry.size);
+            Put(out, static_cast<uint8_t>((entry.globalChecked ? 0x01 : 0) | (entry.globalValid ? 0x02 : 0)));
+            out.write(reinterpret_cast<const char*>(entry.headerBytes.data()), entry.headerBytes.size());
+        }
+        if (!out) {
+            return;
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temp, indexPath, error);
+}
@@ -0,0 +1,109 @@
+#include "save_file.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SAVE_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SaveFile::SaveFile(const std::string& path, size_t size) : path(path), size(size)
+{
+#ifdef SAVE_FILE_MMAP
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t pages = (size + page - 1) / page;
+    chunkSize = page * ((pages + 63) / 64);
+
+    // Only ever grow the file: a .sav written by another emulator may carry
+    // more than the cartridge RAM (e.g. an RTC footer), and that must survive.
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    bool sized = fd >= 0 && fstat(fd, &info) == 0
+        && (static_cast<size_t>(info.st_size) >= size || ftruncate(fd, static_cast<off_t>(size)) == 0);
+    if (sized) {
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mem != MAP_FAILED) {
+            data = static_cast<uint8_t*>(mem);
+            mapped = true;
+            writer = std::thread(&SaveFile::WriterLoop, this);
+            return;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+
+    // Buffered fallback: load what is there now, write it all back on close.
+    chunkSize = std::max<size_t>(1, (size + 63) / 64);
+    buffer.assign(size, 0);
+    std::ifstream file(path, std::ios::binary);
+    if (file.is_open()) {
+        file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(size));
+    }
+    data = buffer.data();
+}
+
+SaveFile::~SaveFile()
+{
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+#ifdef SAVE_FILE_MMAP
+    if (mapped) {
+        FlushDirty();
+        munmap(data, size);
+        close(fd);
+        return;
+    }
+#endif
+
+    // Overwrite the first `size` bytes in place, keeping anything after them.
+    if (dirty.load() != 0) {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file.is_open()) {
+            file.open(path, std::ios::binary | std::ios::out);
+        }
+        file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(size));
+    }
+}
+
+void SaveFile::FlushDirty()
+{
+#ifdef SAVE_FILE_MMAP
+    uint64_t chunks = dirty.exchange(0, std::memory_order_relaxed);
+    while (chunks != 0) {
+        int chunk = std::countr_zero(chunks);
+        chunks &= chunks - 1;
+
+        size_t offset = chunk * chunkSize;
+        size_t length = std::min(chunkSize, size - offset);
+        msync(data + offset, length, MS_SYNC);
+        flushes.fetch_add(1, std::memory_order_relaxed);
+    }
+#endif
+}
+
+void SaveFile::WriterLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        wake.wait_for(guard, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this] { return stopping; });
+        guard.unlock();
+        FlushDirty();
+        guard.lock();
+    }
+}
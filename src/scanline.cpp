@@ -0,0 +1,181 @@
+#include "scanline.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCANLINE_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+#endif
+
+static void DrawScalar(uint8_t* out, int count, const uint8_t* const* rows, int fine, const uint8_t* shades)
+{
+    for (int x = 0; x < count; x++) {
+        int pixel = x + fine;
+        out[x] = shades[rows[pixel >> 3][pixel & 7]];
+    }
+}
+
+static void ExpandScalar(uint32_t* out, const uint8_t* shades, int count, const uint32_t* colors)
+{
+    for (int x = 0; x < count; x++) {
+        out[x] = colors[shades[x]];
+    }
+}
+
+#ifdef SCANLINE_X64
+// Packs the rows into one run of indices, so the fine scroll becomes the
+// offset of an unaligned load instead of a per-pixel tile lookup.
+static void GatherRows(uint8_t* line, int count, const uint8_t* const* rows, int fine)
+{
+    int tiles = (count + fine + 7) >> 3;
+    for (int t = 0; t < tiles; t++) {
+        std::memcpy(line + t * 8, rows[t], 8);
+    }
+}
+
+static inline __m128i Select(__m128i mask, __m128i ifSet, __m128i ifClear)
+{
+    return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+}
+
+// SSE2 has no variable shuffle, so the two index bits each select between
+// palette entries: bit 0 picks within {0,1} and {2,3}, bit 1 between the
+// pairs. 16 pixels per step.
+static void DrawSSE2(uint8_t* out, int count, const uint8_t* const* rows, int fine, const uint8_t* shades)
+{
+    alignas(16) uint8_t line[21 * 8];
+    GatherRows(line, count, rows, fine);
+    const uint8_t* in = line + fine;
+
+    const __m128i bit0 = _mm_set1_epi8(1);
+    const __m128i bit1 = _mm_set1_epi8(2);
+    __m128i shade[4];
+    for (int i = 0; i < 4; i++) {
+        shade[i] = _mm_set1_epi8(static_cast<char>(shades[i]));
+    }
+
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+        __m128i odd = _mm_cmpeq_epi8(_mm_and_si128(index, bit0), bit0);
+        __m128i high = _mm_cmpeq_epi8(_mm_and_si128(index, bit1), bit1);
+        __m128i pixels = Select(high, Select(odd, shade[3], shade[2]), Select(odd, shade[1], shade[0]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), pixels);
+    }
+    for (; x < count; x++) {
+        out[x] = shades[in[x]];
+    }
+}
+
+// Same selection with 32-bit lanes, 16 pixels per step.
+static void ExpandSSE2(uint32_t* out, const uint8_t* shades, int count, const uint32_t* colors)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bit0 = _mm_set1_epi32(1);
+    const __m128i bit1 = _mm_set1_epi32(2);
+    __m128i colour[4];
+    for (int i = 0; i < 4; i++) {
+        colour[i] = _mm_set1_epi32(static_cast<int>(colors[i]));
+    }
+
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + x));
+        __m128i words[2] = { _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero) };
+        for (int half = 0; half < 2; half++) {
+            __m128i quads[2] = { _mm_unpacklo_epi16(words[half], zero), _mm_unpackhi_epi16(words[half], zero) };
+            for (int q = 0; q < 2; q++) {
+                __m128i odd = _mm_cmpeq_epi32(_mm_and_si128(quads[q], bit0), bit0);
+                __m128i high = _mm_cmpeq_epi32(_mm_and_si128(quads[q], bit1), bit1);
+                __m128i pixels = Select(high, Select(odd, colour[3], colour[2]), Select(odd, colour[1], colour[0]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + half * 8 + q * 4), pixels);
+            }
+        }
+    }
+    for (; x < count; x++) {
+        out[x] = colors[shades[x]];
+    }
+}
+
+// The palette is a byte shuffle table: 32 pixels per step.
+TARGET_AVX2 static void DrawAVX2(uint8_t* out, int count, const uint8_t* const* rows, int fine, const uint8_t* shades)
+{
+    alignas(32) uint8_t line[21 * 8];
+    GatherRows(line, count, rows, fine);
+    const uint8_t* in = line + fine;
+
+    uint32_t packed;
+    std::memcpy(&packed, shades, 4);
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_cvtsi32_si128(static_cast<int>(packed)));
+
+    int x = 0;
+    for (; x + 32 <= count; x += 32) {
+        __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_shuffle_epi8(table, index));
+    }
+    for (; x < count; x++) {
+        out[x] = shades[in[x]];
+    }
+}
+
+// 8 pixels per step: the shades widen straight into lanes of a 32-bit
+// permute over the colours.
+TARGET_AVX2 static void ExpandAVX2(uint32_t* out, const uint8_t* shades, int count, const uint32_t* colors)
+{
+    const __m256i palette = _mm256_setr_epi32(
+        static_cast<int>(colors[0]), static_cast<int>(colors[1]), static_cast<int>(colors[2]), static_cast<int>(colors[3]),
+        static_cast<int>(colors[0]), static_cast<int>(colors[1]), static_cast<int>(colors[2]), static_cast<int>(colors[3]));
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(shades + x)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_permutevar8x32_epi32(palette, index));
+    }
+    for (; x < count; x++) {
+        out[x] = colors[shades[x]];
+    }
+}
+
+static bool HostHasAVX2()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) { return false; }
+    // AVX state has to be enabled by the OS as well (OSXSAVE, XCR0)
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 0x6) != 0x6) { return false; }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+#endif
+
+std::vector<ScanlineKernel> ScanlineKernel::Available()
+{
+    std::vector<ScanlineKernel> kernels = { { "scalar", DrawScalar, ExpandScalar } };
+#ifdef SCANLINE_X64
+    kernels.push_back({ "sse2", DrawSSE2, ExpandSSE2 });
+    if (HostHasAVX2()) {
+        kernels.push_back({ "avx2", DrawAVX2, ExpandAVX2 });
+    }
+#endif
+    return kernels;
+}
+
+const ScanlineKernel& ScanlineKernel::Best()
+{
+    static const ScanlineKernel best = Available().back();
+    return best;
+}
@@ -0,0 +1,41 @@
+#include "scheduler.h"
+
+void Scheduler::Schedule(EventType type, uint64_t when)
+{
+    deadlines[Index(type)] = when;
+    UpdateNext();
+}
+
+void Scheduler::Cancel(EventType type)
+{
+    deadlines[Index(type)] = NEVER;
+    UpdateNext();
+}
+
+void Scheduler::UpdateNext()
+{
+    next = NEVER;
+    for (uint64_t deadline : deadlines) {
+        if (deadline < next) {
+            next = deadline;
+        }
+    }
+}
+
+bool Scheduler::PopDue(EventType& type)
+{
+    if (next > now) {
+        return false;
+    }
+
+    // Ties go to the lower event type, so dispatch order is deterministic.
+    for (size_t i = 0; i < EVENT_TYPES; i++) {
+        if (deadlines[i] == next) {
+            type = static_cast<EventType>(i);
+            deadlines[i] = NEVER;
+            UpdateNext();
+            return true;
+        }
+    }
+    return false;
+}
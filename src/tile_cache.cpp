@@ -0,0 +1,29 @@
+#include "tile_cache.h"
+
+void TileCache::DecodeRow(const uint8_t* vram, uint16_t row)
+{
+    // Each row is two bytes: low bit plane, then high bit plane, MSB first.
+    uint8_t lo = vram[row * 2];
+    uint8_t hi = vram[row * 2 + 1];
+    uint8_t* out = &pixels[row * 8];
+    uint8_t mask = 0;
+    for (int x = 0; x < 8; x++) {
+        int bit = 7 - x;
+        out[x] = static_cast<uint8_t>((((hi >> bit) & 1) << 1) | ((lo >> bit) & 1));
+        mask |= (out[x] != 0) << x;
+    }
+    opaque[row] = mask;
+}
+
+void TileCache::Update(const uint8_t* vram, uint16_t offset)
+{
+    DecodeRow(vram, offset / 2);
+    updates++;
+}
+
+void TileCache::Rebuild(const uint8_t* vram)
+{
+    for (uint16_t row = 0; row < TILE_DATA_SIZE / 2; row++) {
+        DecodeRow(vram, row);
+    }
+}
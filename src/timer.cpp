@@ -0,0 +1,89 @@
+#include "timer.h"
+#include "gameboy.h"
+#include "scheduler.h"
+
+Timer::Timer(Gameboy& gb, Scheduler& scheduler) : gb(gb), scheduler(scheduler), state(gb.GetState().timer)
+{
+    state = TimerState();
+    state.counterBase = scheduler.Now();
+    state.lastSync = scheduler.Now();
+}
+
+uint32_t Timer::Period() const
+{
+    // TIMA input clock selected by TAC bits 0-1
+    static const uint32_t periods[4] = { 1024, 16, 64, 256 };
+    return periods[state.tac & 0x03];
+}
+
+uint8_t Timer::Read(uint16_t addr)
+{
+    switch (addr) {
+        case 0xFF04: return static_cast<uint8_t>((scheduler.Now() - state.counterBase) >> 8);
+        case 0xFF05: Sync(); return state.tima;
+        case 0xFF06: return state.tma;
+        case 0xFF07: return state.tac | 0xF8;
+    }
+    return 0xFF;
+}
+
+void Timer::Write(uint16_t addr, uint8_t value)
+{
+    Sync();
+
+    switch (addr) {
+        case 0xFF04: state.counterBase = scheduler.Now(); break;
+        case 0xFF05: state.tima = value; break;
+        case 0xFF06: state.tma = value; break;
+        case 0xFF07: state.tac = value & 0x07; break;
+    }
+
+    ScheduleOverflow();
+}
+
+void Timer::SetDivider(uint16_t counter)
+{
+    Sync();
+    state.counterBase = scheduler.Now() - counter;
+    state.lastSync = scheduler.Now();
+    ScheduleOverflow();
+}
+
+void Timer::OnOverflowEvent()
+{
+    Sync();
+    ScheduleOverflow();
+}
+
+void Timer::Sync()
+{
+    uint64_t now = scheduler.Now();
+    if (Enabled()) {
+        // TIMA counts the times the divider crossed a multiple of the period.
+        uint32_t period = Period();
+        uint64_t increments = (now - state.counterBase) / period - (state.lastSync - state.counterBase) / period;
+        uint64_t total = state.tima + increments;
+
+        if (total > 0xFF) {
+            uint64_t range = 0x100 - state.tma;
+            state.tima = static_cast<uint8_t>(state.tma + (total - 0x100) % range);
+            gb.RequestInterrupt(2);
+        } else {
+            state.tima = static_cast<uint8_t>(total);
+        }
+    }
+    state.lastSync = now;
+}
+
+void Timer::ScheduleOverflow()
+{
+    if (!Enabled()) {
+        scheduler.Cancel(EventType::TimerOverflow);
+        return;
+    }
+
+    uint32_t period = Period();
+    uint64_t now = scheduler.Now();
+    uint64_t nextIncrement = now + period - (now - state.counterBase) % period;
+    scheduler.Schedule(EventType::TimerOverflow, nextIncrement + static_cast<uint64_t>(0xFF - state.tima) * period);
+}